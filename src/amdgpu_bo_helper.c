@@ -23,14 +23,16 @@
 #include <xorg-server.h>
 
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <gbm.h>
+#include <drm_fourcc.h>
 
 #include "amdgpu_drv.h"
 #include "amdgpu_bo_helper.h"
 #include "amdgpu_glamor.h"
 #include "amdgpu_pixmap.h"
 
-static uint32_t
+uint32_t
 amdgpu_get_gbm_format(int depth, int bitsPerPixel)
 {
 	switch (depth) {
@@ -57,6 +59,185 @@ amdgpu_get_gbm_format(int depth, int bitsPerPixel)
 	}
 }
 
+/* Don't query memory usage from the kernel more often than this (in ms) */
+#define AMDGPU_MEM_QUERY_INTERVAL 100
+
+static const char *amdgpu_mem_domain_names[AMDGPU_MEM_NUM_DOMAINS] = {
+	"VRAM", "GTT"
+};
+
+/* Refresh the kernel reported memory usage, and determine whether VRAM usage
+ * is above the configured threshold
+ */
+static Bool
+amdgpu_mem_vram_pressure(ScrnInfoPtr pScrn)
+{
+	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
+	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(pScrn);
+	struct amdgpu_mem_stats *stats = &pAMDGPUEnt->mem_stats;
+	static const uint32_t heaps[AMDGPU_MEM_NUM_DOMAINS] = {
+		AMDGPU_GEM_DOMAIN_VRAM, AMDGPU_GEM_DOMAIN_GTT
+	};
+	struct amdgpu_heap_info heap_info;
+	CARD32 now = GetTimeInMillis();
+	Bool pressure;
+	int i;
+
+	if (info->vram_pressure_threshold == 0)
+		return FALSE;
+
+	if (stats->query_time &&
+	    (CARD32)(now - stats->query_time) < AMDGPU_MEM_QUERY_INTERVAL)
+		return stats->vram_pressure;
+
+	stats->query_time = now;
+
+	for (i = 0; i < AMDGPU_MEM_NUM_DOMAINS; i++) {
+		memset(&heap_info, 0, sizeof(heap_info));
+		if (amdgpu_query_heap_info(pAMDGPUEnt->pDev, heaps[i], 0,
+					   &heap_info) == 0) {
+			stats->usage[i] = heap_info.heap_usage;
+			stats->size[i] = heap_info.heap_size;
+		}
+	}
+
+	pressure = stats->size[AMDGPU_MEM_VRAM] &&
+		stats->usage[AMDGPU_MEM_VRAM] * 100 >=
+		stats->size[AMDGPU_MEM_VRAM] * info->vram_pressure_threshold;
+
+	if (pressure != stats->vram_pressure) {
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+			   "VRAM usage %llu of %llu MiB, %s\n",
+			   (unsigned long long)(stats->usage[AMDGPU_MEM_VRAM] >> 20),
+			   (unsigned long long)(stats->size[AMDGPU_MEM_VRAM] >> 20),
+			   pressure ? "allocating pixmaps in GTT" :
+			   "allocating pixmaps in VRAM again");
+		stats->vram_pressure = pressure;
+	}
+
+	return pressure;
+}
+
+static void
+amdgpu_mem_account(ScrnInfoPtr pScrn, struct amdgpu_buffer *bo,
+		   enum amdgpu_mem_domain domain, uint64_t size)
+{
+	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(pScrn);
+
+	bo->mem_stats = &pAMDGPUEnt->mem_stats;
+	bo->mem_domain = domain;
+	bo->mem_size = size;
+	bo->mem_stats->allocated[domain] += size;
+}
+
+/* Log the memory usage numbers tracked for the entity */
+void
+amdgpu_mem_stats_log(ScrnInfoPtr pScrn, int verb)
+{
+	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(pScrn);
+	struct amdgpu_mem_stats *stats = &pAMDGPUEnt->mem_stats;
+	int i;
+
+	for (i = 0; i < AMDGPU_MEM_NUM_DOMAINS; i++) {
+		xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, verb,
+			       "%s: %llu KiB allocated by driver, "
+			       "%llu of %llu KiB in use\n",
+			       amdgpu_mem_domain_names[i],
+			       (unsigned long long)(stats->allocated[i] >> 10),
+			       (unsigned long long)(stats->usage[i] >> 10),
+			       (unsigned long long)(stats->size[i] >> 10));
+	}
+
+	xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, verb,
+		       "%llu pixmaps allocated in GTT due to VRAM pressure\n",
+		       (unsigned long long)stats->num_steered);
+}
+
+/* Create an FB for a GBM BO with an explicit modifier, including any
+ * additional planes (e.g. DCC metadata)
+ */
+static int
+amdgpu_gbm_bo_add_fb(int drm_fd, struct gbm_bo *bo, uint32_t width,
+		     uint32_t height, uint32_t *fb_id)
+{
+	uint32_t handles[4] = { 0 }, pitches[4] = { 0 }, offsets[4] = { 0 };
+	uint64_t modifiers[4] = { 0 };
+	uint64_t modifier = gbm_bo_get_modifier(bo);
+	int num_planes = gbm_bo_get_plane_count(bo);
+	int i;
+
+	for (i = 0; i < num_planes && i < 4; i++) {
+		handles[i] = gbm_bo_get_handle_for_plane(bo, i).u32;
+		pitches[i] = gbm_bo_get_stride_for_plane(bo, i);
+		offsets[i] = gbm_bo_get_offset(bo, i);
+		modifiers[i] = modifier;
+	}
+
+	return drmModeAddFB2WithModifiers(drm_fd, width, height,
+					  gbm_bo_get_format(bo), handles,
+					  pitches, offsets, modifiers, fb_id,
+					  DRM_MODE_FB_MODIFIERS);
+}
+
+/* Create an FB for a BO allocated with an explicit modifier */
+struct drmmode_fb *
+amdgpu_fb_create_with_modifier(ScrnInfoPtr scrn, struct amdgpu_buffer *bo,
+			       uint32_t width, uint32_t height)
+{
+	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(scrn);
+	struct drmmode_fb *fb = malloc(sizeof(*fb));
+
+	if (!fb)
+		return NULL;
+
+	fb->refcnt = 1;
+	if (amdgpu_gbm_bo_add_fb(pAMDGPUEnt->fd, bo->bo.gbm, width, height,
+				 &fb->handle) == 0)
+		return fb;
+
+	free(fb);
+	return NULL;
+}
+
+#if HAVE_GBM_BO_CREATE_WITH_MODIFIERS2
+/* Allocate a scanout BO with one of the modifiers supported by the primary
+ * planes, which allows e.g. displayable DCC. If the kernel rejects an FB for
+ * the resulting BO, modifiers aren't used for scanout BOs anymore.
+ */
+static struct gbm_bo *
+amdgpu_alloc_scanout_bo_with_modifiers(ScrnInfoPtr pScrn, int width,
+				       int height, uint32_t gbm_format,
+				       uint32_t bo_use)
+{
+	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
+	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(pScrn);
+	struct gbm_bo *bo;
+	uint32_t fb_id;
+
+	bo = gbm_bo_create_with_modifiers2(info->gbm, width, height, gbm_format,
+					   info->drmmode.scanout_modifiers,
+					   info->drmmode.num_scanout_modifiers,
+					   bo_use);
+	if (bo) {
+		if (amdgpu_gbm_bo_add_fb(pAMDGPUEnt->fd, bo, width, height,
+					 &fb_id) == 0) {
+			drmModeRmFB(pAMDGPUEnt->fd, fb_id);
+			return bo;
+		}
+
+		gbm_bo_destroy(bo);
+	}
+
+	xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+		   "Failed to allocate scanout buffer with modifier, "
+		   "falling back to implicit tiling\n");
+	free(info->drmmode.scanout_modifiers);
+	info->drmmode.scanout_modifiers = NULL;
+	info->drmmode.num_scanout_modifiers = 0;
+	return NULL;
+}
+#endif
+
 /* Calculate appropriate pitch for a pixmap and allocate a BO that can hold it.
  */
 struct amdgpu_buffer *amdgpu_alloc_pixmap_bo(ScrnInfoPtr pScrn, int width,
@@ -66,6 +247,19 @@ struct amdgpu_buffer *amdgpu_alloc_pixmap_bo(ScrnInfoPtr pScrn, int width,
 	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
 	struct amdgpu_buffer *pixmap_buffer;
 
+	/* Move pixmaps which are never scanned out or shared to GTT while
+	 * VRAM is overcommitted, to avoid evicting scanout BOs
+	 */
+	if (!(usage_hint & (AMDGPU_CREATE_PIXMAP_GTT |
+			    AMDGPU_CREATE_PIXMAP_SCANOUT |
+			    AMDGPU_CREATE_PIXMAP_FRONT |
+			    AMDGPU_CREATE_PIXMAP_DRI2)) &&
+	    !AMDGPU_CREATE_PIXMAP_SHARED(usage_hint) &&
+	    amdgpu_mem_vram_pressure(pScrn)) {
+		AMDGPUEntPriv(pScrn)->mem_stats.num_steered++;
+		usage_hint |= AMDGPU_CREATE_PIXMAP_GTT;
+	}
+
 	if (!(usage_hint & AMDGPU_CREATE_PIXMAP_GTT) && info->gbm) {
 		uint32_t bo_use = GBM_BO_USE_RENDERING;
 		uint32_t gbm_format = amdgpu_get_gbm_format(depth, bitsPerPixel);
@@ -78,6 +272,7 @@ struct amdgpu_buffer *amdgpu_alloc_pixmap_bo(ScrnInfoPtr pScrn, int width,
 			return NULL;
 		}
 		pixmap_buffer->ref_count = 1;
+		xorg_list_init(&pixmap_buffer->cpu_map_lru);
 
 		if (usage_hint & AMDGPU_CREATE_PIXMAP_SCANOUT)
 			bo_use |= GBM_BO_USE_SCANOUT;
@@ -94,6 +289,22 @@ struct amdgpu_buffer *amdgpu_alloc_pixmap_bo(ScrnInfoPtr pScrn, int width,
 		}
 #endif
 
+#if HAVE_GBM_BO_CREATE_WITH_MODIFIERS2
+		if ((usage_hint & AMDGPU_CREATE_PIXMAP_SCANOUT) &&
+		    !(usage_hint & AMDGPU_CREATE_PIXMAP_LINEAR) &&
+		    usage_hint != CREATE_PIXMAP_USAGE_SHARED &&
+		    info->drmmode.num_scanout_modifiers > 0) {
+			pixmap_buffer->bo.gbm =
+				amdgpu_alloc_scanout_bo_with_modifiers(pScrn, width,
+								       height,
+								       gbm_format,
+								       bo_use);
+			if (pixmap_buffer->bo.gbm)
+				pixmap_buffer->flags |= AMDGPU_BO_FLAGS_MODIFIER;
+		}
+
+		if (!pixmap_buffer->bo.gbm)
+#endif
 		pixmap_buffer->bo.gbm = gbm_bo_create(info->gbm, width, height,
 						      gbm_format,
 						      bo_use);
@@ -104,6 +315,10 @@ struct amdgpu_buffer *amdgpu_alloc_pixmap_bo(ScrnInfoPtr pScrn, int width,
 
 		pixmap_buffer->flags |= AMDGPU_BO_FLAGS_GBM;
 
+		amdgpu_mem_account(pScrn, pixmap_buffer, AMDGPU_MEM_VRAM,
+				   (uint64_t)gbm_bo_get_stride(pixmap_buffer->bo.gbm) *
+				   gbm_bo_get_height(pixmap_buffer->bo.gbm));
+
 		if (new_pitch)
 			*new_pitch = gbm_bo_get_stride(pixmap_buffer->bo.gbm);
 	} else {
@@ -116,6 +331,13 @@ struct amdgpu_buffer *amdgpu_alloc_pixmap_bo(ScrnInfoPtr pScrn, int width,
 
 		pixmap_buffer = amdgpu_bo_open(pAMDGPUEnt->pDev, pitch * height,
 					       4096, domain);
+		if (!pixmap_buffer)
+			return NULL;
+
+		amdgpu_mem_account(pScrn, pixmap_buffer,
+				   domain == AMDGPU_GEM_DOMAIN_GTT ?
+				   AMDGPU_MEM_GTT : AMDGPU_MEM_VRAM,
+				   (uint64_t)pitch * height);
 
 		if (new_pitch)
 			*new_pitch = pitch;
@@ -146,29 +368,51 @@ amdgpu_pixmap_clear(PixmapPtr pixmap)
 
 Bool amdgpu_bo_get_handle(struct amdgpu_buffer *bo, uint32_t *handle)
 {
-	if (bo->flags & AMDGPU_BO_FLAGS_GBM) {
-		*handle = gbm_bo_get_handle(bo->bo.gbm).u32;
+	if (bo->flags & AMDGPU_BO_FLAGS_HANDLE_VALID) {
+		*handle = bo->handle;
 		return TRUE;
 	}
 
-	return amdgpu_bo_export(bo->bo.amdgpu, amdgpu_bo_handle_type_kms,
-				handle) == 0;
+	if (bo->flags & AMDGPU_BO_FLAGS_GBM) {
+		bo->handle = gbm_bo_get_handle(bo->bo.gbm).u32;
+	} else if (amdgpu_bo_export(bo->bo.amdgpu, amdgpu_bo_handle_type_kms,
+				    &bo->handle) != 0) {
+		return FALSE;
+	}
+
+	bo->flags |= AMDGPU_BO_FLAGS_HANDLE_VALID;
+	*handle = bo->handle;
+	return TRUE;
 }
 
-static void amdgpu_pixmap_do_get_tiling_info(PixmapPtr pixmap)
+static uint64_t amdgpu_do_get_tiling_info(ScrnInfoPtr scrn, uint32_t handle)
 {
-	struct amdgpu_pixmap *priv = amdgpu_get_pixmap_private(pixmap);
-	ScreenPtr screen = pixmap->drawable.pScreen;
-	ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
 	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(scrn);
 	struct drm_amdgpu_gem_metadata gem_metadata;
 
-	gem_metadata.handle = priv->handle;
+	memset(&gem_metadata, 0, sizeof(gem_metadata));
+	gem_metadata.handle = handle;
 	gem_metadata.op = AMDGPU_GEM_METADATA_OP_GET_METADATA;
 
 	if (drmCommandWriteRead(pAMDGPUEnt->fd, DRM_AMDGPU_GEM_METADATA,
 				&gem_metadata, sizeof(gem_metadata)) == 0)
-		priv->tiling_info = gem_metadata.data.tiling_info;
+		return gem_metadata.data.tiling_info;
+
+	return 0;
+}
+
+/* The tiling metadata of a BO doesn't change after it was created, so it only
+ * needs to be queried from the kernel once per BO
+ */
+static uint64_t amdgpu_bo_get_tiling_info(ScrnInfoPtr scrn,
+					  struct amdgpu_buffer *bo)
+{
+	if (!(bo->flags & AMDGPU_BO_FLAGS_TILING_VALID)) {
+		bo->tiling_info = amdgpu_do_get_tiling_info(scrn, bo->handle);
+		bo->flags |= AMDGPU_BO_FLAGS_TILING_VALID;
+	}
+
+	return bo->tiling_info;
 }
 
 uint64_t amdgpu_pixmap_get_tiling_info(PixmapPtr pixmap)
@@ -203,12 +447,29 @@ Bool amdgpu_pixmap_get_handle(PixmapPtr pixmap, uint32_t *handle)
 	if (priv->handle_valid)
 		goto success;
 
+	/* Use the handle and tiling metadata cached in the BO if possible,
+	 * this doesn't need any syscalls after the first time
+	 */
+	if (priv->bo) {
+		if (!amdgpu_bo_get_handle(priv->bo, &priv->handle))
+			return FALSE;
+
+		if (info->use_glamor)
+			priv->tiling_info = amdgpu_bo_get_tiling_info(scrn, priv->bo);
+		goto success;
+	}
+
 	if (info->use_glamor) {
 		AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(scrn);
 		CARD16 stride;
 		CARD32 size;
 		int fd, r;
 
+		/* glamor may reallocate the pixmap storage to make it
+		 * exportable
+		 */
+		amdgpu_pixmap_invalidate_export(priv);
+
 		fd = glamor_fd_from_pixmap(screen, pixmap, &stride, &size);
 		if (fd < 0)
 			return FALSE;
@@ -218,12 +479,11 @@ Bool amdgpu_pixmap_get_handle(PixmapPtr pixmap, uint32_t *handle)
 		if (r)
 			return FALSE;
 
-		amdgpu_pixmap_do_get_tiling_info(pixmap);
+		priv->tiling_info = amdgpu_do_get_tiling_info(scrn, priv->handle);
 		goto success;
 	}
 
-	if (!priv->bo || !amdgpu_bo_get_handle(priv->bo, &priv->handle))
-		return FALSE;
+	return FALSE;
 
  success:
 	priv->handle_valid = TRUE;
@@ -231,10 +491,66 @@ Bool amdgpu_pixmap_get_handle(PixmapPtr pixmap, uint32_t *handle)
 	return TRUE;
 }
 
+/* CPU mappings of BOs are kept around after amdgpu_bo_unmap, so that repeated
+ * CPU access to the same BO doesn't need any syscalls. Mappings which aren't
+ * in use are kept on an LRU list and only torn down when the total size of
+ * unused mappings exceeds AMDGPU_BO_MAP_CACHE_SIZE, or when the BO is
+ * destroyed.
+ */
+#define AMDGPU_BO_MAP_CACHE_SIZE (256 * 1024 * 1024)
+
+static struct xorg_list amdgpu_bo_map_lru = {
+	&amdgpu_bo_map_lru, &amdgpu_bo_map_lru
+};
+static uint64_t amdgpu_bo_map_lru_size;
+
+static void amdgpu_bo_do_unmap(struct amdgpu_buffer *bo)
+{
+	if (bo->flags & AMDGPU_BO_FLAGS_GBM)
+		munmap(bo->cpu_ptr, bo->cpu_map_size);
+	else
+		amdgpu_bo_cpu_unmap(bo->bo.amdgpu);
+
+	bo->cpu_ptr = NULL;
+	bo->cpu_map_size = 0;
+}
+
+/* BOs mapped directly with amdgpu_bo_cpu_map, e.g. the cursor BOs, are
+ * never on the LRU list
+ */
+static void amdgpu_bo_map_lru_del(struct amdgpu_buffer *bo)
+{
+	if (xorg_list_is_empty(&bo->cpu_map_lru))
+		return;
+
+	xorg_list_del(&bo->cpu_map_lru);
+	amdgpu_bo_map_lru_size -= bo->cpu_map_size;
+}
+
+/* Tear down unused mappings until there's room for size more bytes */
+static void amdgpu_bo_map_lru_evict(uint64_t size)
+{
+	struct amdgpu_buffer *bo;
+
+	while (amdgpu_bo_map_lru_size + size > AMDGPU_BO_MAP_CACHE_SIZE &&
+	       !xorg_list_is_empty(&amdgpu_bo_map_lru)) {
+		bo = xorg_list_first_entry(&amdgpu_bo_map_lru,
+					   struct amdgpu_buffer, cpu_map_lru);
+		amdgpu_bo_map_lru_del(bo);
+		amdgpu_bo_do_unmap(bo);
+	}
+}
+
 int amdgpu_bo_map(ScrnInfoPtr pScrn, struct amdgpu_buffer *bo)
 {
 	int ret = 0;
 
+	if (bo->cpu_ptr) {
+		if (bo->cpu_map_count++ == 0)
+			amdgpu_bo_map_lru_del(bo);
+		return 0;
+	}
+
 	if (bo->flags & AMDGPU_BO_FLAGS_GBM) {
 		AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(pScrn);
 		uint32_t handle, stride, height;
@@ -256,34 +572,47 @@ int amdgpu_bo_map(ScrnInfoPtr pScrn, struct amdgpu_buffer *bo)
 			return ret;
 		}
 
+		amdgpu_bo_map_lru_evict(stride * height);
+
 		ptr = mmap(NULL, stride * height,
 			PROT_READ | PROT_WRITE, MAP_SHARED,
 			fd, args.out.addr_ptr);
 
-		if (!ptr) {
+		if (ptr == MAP_FAILED) {
 			ErrorF("Failed to mmap the bo\n");
 			return -1;
 		}
 
 		bo->cpu_ptr = ptr;
-	} else
+		bo->cpu_map_size = stride * height;
+	} else {
+		if (amdgpu_query_bo_size(bo->bo.amdgpu, &bo->cpu_map_size) == 0)
+			amdgpu_bo_map_lru_evict(bo->cpu_map_size);
+
 		ret = amdgpu_bo_cpu_map(bo->bo.amdgpu, &bo->cpu_ptr);
+		if (ret) {
+			bo->cpu_ptr = NULL;
+			bo->cpu_map_size = 0;
+			return ret;
+		}
+	}
 
+	bo->cpu_map_count = 1;
 	return ret;
 }
 
 void amdgpu_bo_unmap(struct amdgpu_buffer *bo)
 {
-	if (!bo->cpu_ptr)
+	if (!bo->cpu_ptr || bo->cpu_map_count == 0)
 		return;
 
-	if (bo->flags & AMDGPU_BO_FLAGS_GBM) {
-		uint32_t stride, height;
-		stride = gbm_bo_get_stride(bo->bo.gbm);
-		height = gbm_bo_get_height(bo->bo.gbm);
-		munmap(bo->cpu_ptr, stride * height);
-	} else
-		amdgpu_bo_cpu_unmap(bo->bo.amdgpu);
+	if (--bo->cpu_map_count)
+		return;
+
+	/* Keep the mapping around for the next amdgpu_bo_map call */
+	xorg_list_append(&bo->cpu_map_lru, &amdgpu_bo_map_lru);
+	amdgpu_bo_map_lru_size += bo->cpu_map_size;
+	amdgpu_bo_map_lru_evict(0);
 }
 
 struct amdgpu_buffer *amdgpu_bo_open(amdgpu_device_handle pDev,
@@ -310,6 +639,7 @@ struct amdgpu_buffer *amdgpu_bo_open(amdgpu_device_handle pDev,
 	}
 
 	bo->ref_count = 1;
+	xorg_list_init(&bo->cpu_map_lru);
 
 	return bo;
 }
@@ -319,6 +649,128 @@ void amdgpu_bo_ref(struct amdgpu_buffer *buffer)
 	buffer->ref_count++;
 }
 
+/* dma-buf imports of the same memory with the same layout on the same DRM
+ * file description share their BO, so that clients sharing the same buffers
+ * again only pay for creating the pixmap itself. Entries don't hold a
+ * reference to the BO; they are removed when the BO is destroyed, see
+ * amdgpu_bo_unref.
+ */
+struct amdgpu_import {
+	struct xorg_list link;
+	struct amdgpu_import_key key;
+	struct amdgpu_buffer *bo;
+	struct drmmode_fb *fb;
+	int drm_fd;
+};
+
+static struct xorg_list amdgpu_import_cache = {
+	&amdgpu_import_cache, &amdgpu_import_cache
+};
+
+Bool amdgpu_import_key_init(struct amdgpu_import_key *key, int num_planes,
+			    const int *fds, uint32_t width, uint32_t height,
+			    uint32_t format, const uint32_t *strides,
+			    const uint32_t *offsets, uint64_t modifier)
+{
+	struct stat st;
+	int i;
+
+	if (num_planes < 1 || num_planes > (int)ARRAY_SIZE(key->ino))
+		return FALSE;
+
+	/* Zero any padding as well, so that keys can be compared with memcmp */
+	memset(key, 0, sizeof(*key));
+
+	/* A dma-buf keeps its inode for as long as it exists, and the cached
+	 * BO keeps it alive
+	 */
+	for (i = 0; i < num_planes; i++) {
+		if (fstat(fds[i], &st) != 0)
+			return FALSE;
+
+		key->dev[i] = st.st_dev;
+		key->ino[i] = st.st_ino;
+		key->strides[i] = strides[i];
+		key->offsets[i] = offsets[i];
+	}
+
+	key->num_planes = num_planes;
+	key->width = width;
+	key->height = height;
+	key->format = format;
+	key->modifier = modifier;
+	return TRUE;
+}
+
+struct amdgpu_buffer *
+amdgpu_import_cache_lookup(const struct amdgpu_import_key *key, int drm_fd)
+{
+	struct amdgpu_import *import;
+
+	/* BOs, GEM handles and FBs are only valid for the device they were
+	 * imported on
+	 */
+	xorg_list_for_each_entry(import, &amdgpu_import_cache, link) {
+		if (import->drm_fd == drm_fd &&
+		    memcmp(&import->key, key, sizeof(*key)) == 0) {
+			amdgpu_bo_ref(import->bo);
+			return import->bo;
+		}
+	}
+
+	return NULL;
+}
+
+void amdgpu_import_cache_add(struct amdgpu_buffer *bo,
+			     const struct amdgpu_import_key *key, int drm_fd)
+{
+	struct amdgpu_import *import;
+
+	if (bo->import)
+		return;
+
+	import = calloc(1, sizeof(*import));
+	if (!import)
+		return;
+
+	import->key = *key;
+	import->bo = bo;
+	import->drm_fd = drm_fd;
+	xorg_list_add(&import->link, &amdgpu_import_cache);
+	bo->import = import;
+}
+
+struct drmmode_fb *amdgpu_import_cache_get_fb(struct amdgpu_buffer *bo)
+{
+	return bo->import ? bo->import->fb : NULL;
+}
+
+void amdgpu_import_cache_set_fb(struct amdgpu_buffer *bo, struct drmmode_fb *fb)
+{
+	if (bo->import)
+		drmmode_fb_reference(bo->import->drm_fd, &bo->import->fb, fb);
+}
+
+void amdgpu_import_cache_release_fbs(int drm_fd)
+{
+	struct amdgpu_import *import;
+
+	xorg_list_for_each_entry(import, &amdgpu_import_cache, link) {
+		if (import->drm_fd == drm_fd)
+			drmmode_fb_reference(drm_fd, &import->fb, NULL);
+	}
+}
+
+static void amdgpu_import_cache_del(struct amdgpu_buffer *bo)
+{
+	struct amdgpu_import *import = bo->import;
+
+	drmmode_fb_reference(import->drm_fd, &import->fb, NULL);
+	xorg_list_del(&import->link);
+	free(import);
+	bo->import = NULL;
+}
+
 void amdgpu_bo_unref(struct amdgpu_buffer **buffer)
 {
 	struct amdgpu_buffer *buf = *buffer;
@@ -328,7 +780,17 @@ void amdgpu_bo_unref(struct amdgpu_buffer **buffer)
 		return;
 	}
 
-	amdgpu_bo_unmap(buf);
+	if (buf->cpu_ptr) {
+		if (buf->cpu_map_count == 0)
+			amdgpu_bo_map_lru_del(buf);
+		amdgpu_bo_do_unmap(buf);
+	}
+
+	if (buf->mem_stats)
+		buf->mem_stats->allocated[buf->mem_domain] -= buf->mem_size;
+
+	if (buf->import)
+		amdgpu_import_cache_del(buf);
 
 	if (buf->flags & AMDGPU_BO_FLAGS_GBM) {
 		gbm_bo_destroy(buf->bo.gbm);
@@ -393,6 +855,7 @@ struct amdgpu_buffer *amdgpu_gem_bo_open_prime(amdgpu_device_handle pDev,
 	}
 	bo->bo.amdgpu = buffer.buf_handle;
 	bo->ref_count = 1;
+	xorg_list_init(&bo->cpu_map_lru);
 
 	return bo;
 }
@@ -413,18 +876,32 @@ Bool amdgpu_set_shared_pixmap_backing(PixmapPtr ppix, void *fd_handle)
 
 	if (info->gbm) {
 		struct amdgpu_buffer *bo;
+		struct amdgpu_import_key key;
 		struct gbm_import_fd_data data;
 		uint32_t bo_use = GBM_BO_USE_RENDERING;
+		uint32_t stride = ppix->devKind, offset = 0;
+		Bool cacheable;
 
 		data.format = amdgpu_get_gbm_format(ppix->drawable.depth,
 						    ppix->drawable.bitsPerPixel);
 		if (data.format == ~0U)
 			return FALSE;
 
+		cacheable = amdgpu_import_key_init(&key, 1, &ihandle,
+						   ppix->drawable.width,
+						   ppix->drawable.height,
+						   data.format, &stride, &offset,
+						   DRM_FORMAT_MOD_INVALID);
+		bo = cacheable ?
+			amdgpu_import_cache_lookup(&key, pAMDGPUEnt->fd) : NULL;
+		if (bo)
+			goto create_texture;
+
 		bo = calloc(1, sizeof(struct amdgpu_buffer));
 		if (!bo)
 			return FALSE;
 		bo->ref_count = 1;
+		xorg_list_init(&bo->cpu_map_lru);
 
 		data.fd = ihandle;
 		data.width = ppix->drawable.width;
@@ -443,6 +920,11 @@ Bool amdgpu_set_shared_pixmap_backing(PixmapPtr ppix, void *fd_handle)
 
 		bo->flags |= AMDGPU_BO_FLAGS_GBM;
 
+		if (cacheable)
+			amdgpu_import_cache_add(bo, &key, pAMDGPUEnt->fd);
+
+create_texture:
+
 		if (info->use_glamor &&
 		    !amdgpu_glamor_create_textured_pixmap(ppix, bo)) {
 			amdgpu_bo_unref(&bo);
@@ -23,12 +23,22 @@
 #ifndef AMDGPU_BO_HELPER_H
 #define AMDGPU_BO_HELPER_H 1
 
+#include <sys/types.h>
+
 #include "amdgpu_drv.h"
 
+extern uint32_t amdgpu_get_gbm_format(int depth, int bitsPerPixel);
+
+extern struct drmmode_fb *
+amdgpu_fb_create_with_modifier(ScrnInfoPtr scrn, struct amdgpu_buffer *bo,
+			       uint32_t width, uint32_t height);
+
 extern struct amdgpu_buffer *amdgpu_alloc_pixmap_bo(ScrnInfoPtr pScrn, int width,
 						     int height, int depth, int usage_hint,
 						     int bitsPerPixel, int *new_pitch);
 
+extern void amdgpu_mem_stats_log(ScrnInfoPtr pScrn, int verb);
+
 extern void amdgpu_pixmap_clear(PixmapPtr pixmap);
 
 extern Bool amdgpu_bo_get_handle(struct amdgpu_buffer *bo, uint32_t *handle);
@@ -37,13 +47,77 @@ extern uint64_t amdgpu_pixmap_get_tiling_info(PixmapPtr pixmap);
 
 extern Bool amdgpu_pixmap_get_handle(PixmapPtr pixmap, uint32_t *handle);
 
+/* helper function to map a amdgpu_buffer for CPU access
+ * \param	pScrn	- \c [in] screen
+ * \param	bo	- \c [in] amdgpu_buffer, bo->cpu_ptr is valid on success
+ *
+ * \return	0 on success
+ *		non-zero on failure
+ *
+ * Each successful call must be balanced by amdgpu_bo_unmap (or by dropping
+ * the last reference). The mapping is cached after the last amdgpu_bo_unmap
+ * and reused by subsequent calls, until memory pressure evicts it.
+*/
 extern int amdgpu_bo_map(ScrnInfoPtr pScrn, struct amdgpu_buffer *bo);
 
+/* helper function to release a CPU mapping obtained with amdgpu_bo_map
+ * \param	bo	- \c [in] amdgpu_buffer
+*/
 extern void amdgpu_bo_unmap(struct amdgpu_buffer *bo);
 
 extern Bool
 amdgpu_set_shared_pixmap_backing(PixmapPtr ppix, void *fd_handle);
 
+/* Identifies the memory and layout of an imported dma-buf */
+struct amdgpu_import_key {
+	dev_t dev[4];
+	ino_t ino[4];
+	uint32_t num_planes;
+	uint32_t width;
+	uint32_t height;
+	uint32_t format;
+	uint32_t strides[4];
+	uint32_t offsets[4];
+	uint64_t modifier;
+};
+
+/* helper function to initialize the import cache key for a dma-buf import
+ *
+ * \return	TRUE on success
+ *		FALSE if the import can't be cached
+*/
+extern Bool amdgpu_import_key_init(struct amdgpu_import_key *key,
+				   int num_planes, const int *fds,
+				   uint32_t width, uint32_t height,
+				   uint32_t format, const uint32_t *strides,
+				   const uint32_t *offsets, uint64_t modifier);
+
+/* helper function to look up a BO previously imported from the same memory
+ * with the same layout on the same DRM file descriptor
+ *
+ * \return	the BO with an additional reference on success
+ *		NULL if there's no such BO
+*/
+extern struct amdgpu_buffer *
+amdgpu_import_cache_lookup(const struct amdgpu_import_key *key, int drm_fd);
+
+/* helper function to make an imported BO available to
+ * amdgpu_import_cache_lookup, until the BO is destroyed
+*/
+extern void amdgpu_import_cache_add(struct amdgpu_buffer *bo,
+				    const struct amdgpu_import_key *key,
+				    int drm_fd);
+
+/* helper functions to share the FB of an imported BO between pixmaps */
+extern struct drmmode_fb *amdgpu_import_cache_get_fb(struct amdgpu_buffer *bo);
+extern void amdgpu_import_cache_set_fb(struct amdgpu_buffer *bo,
+				       struct drmmode_fb *fb);
+
+/* helper function to drop the FB references held by the import cache for the
+ * given DRM file descriptor, e.g. when leaving the VT
+*/
+extern void amdgpu_import_cache_release_fbs(int drm_fd);
+
 /* helper function to allocate memory to be used for GPU operations
  *
  * \param	pDev		- \c [in] device handle
@@ -0,0 +1,162 @@
+/*
+ * Copyright © 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "amdgpu_copy.h"
+
+/*
+ * Copies to write-combined memory, e.g. from the ShadowFB shadow to the
+ * front buffer. Non-temporal stores write full cache lines straight to
+ * memory, and don't evict the shadow contents from the caches. The fastest
+ * available implementation is picked at runtime.
+ *
+ * Nothing here may depend on the X server: test/copy_bench.c builds this
+ * file on its own.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#define AMDGPU_COPY_STREAMING 1
+
+/* Copy with plain stores until dst is aligned to align bytes */
+static size_t
+amdgpu_copy_head(uint8_t *dst, const uint8_t *src, size_t size, size_t align)
+{
+	size_t head = (align - ((uintptr_t)dst & (align - 1))) & (align - 1);
+
+	if (head > size)
+		head = size;
+
+	memcpy(dst, src, head);
+	return head;
+}
+
+__attribute__((target("sse2"))) static void
+amdgpu_copy_to_wc_sse2(void *dst, const void *src, size_t size)
+{
+	const uint8_t *s = src;
+	uint8_t *d = dst;
+	size_t head = amdgpu_copy_head(d, s, size, 16);
+
+	d += head;
+	s += head;
+	size -= head;
+
+	for (; size >= 64; size -= 64, s += 64, d += 64) {
+		__m128i a = _mm_loadu_si128((const __m128i *)s);
+		__m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *)(s + 32));
+		__m128i e = _mm_loadu_si128((const __m128i *)(s + 48));
+
+		_mm_stream_si128((__m128i *)d, a);
+		_mm_stream_si128((__m128i *)(d + 16), b);
+		_mm_stream_si128((__m128i *)(d + 32), c);
+		_mm_stream_si128((__m128i *)(d + 48), e);
+	}
+
+	for (; size >= 16; size -= 16, s += 16, d += 16)
+		_mm_stream_si128((__m128i *)d,
+				 _mm_loadu_si128((const __m128i *)s));
+
+	memcpy(d, s, size);
+}
+
+__attribute__((target("avx2"))) static void
+amdgpu_copy_to_wc_avx2(void *dst, const void *src, size_t size)
+{
+	const uint8_t *s = src;
+	uint8_t *d = dst;
+	size_t head = amdgpu_copy_head(d, s, size, 32);
+
+	d += head;
+	s += head;
+	size -= head;
+
+	for (; size >= 128; size -= 128, s += 128, d += 128) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)s);
+		__m256i b = _mm256_loadu_si256((const __m256i *)(s + 32));
+		__m256i c = _mm256_loadu_si256((const __m256i *)(s + 64));
+		__m256i e = _mm256_loadu_si256((const __m256i *)(s + 96));
+
+		_mm256_stream_si256((__m256i *)d, a);
+		_mm256_stream_si256((__m256i *)(d + 32), b);
+		_mm256_stream_si256((__m256i *)(d + 64), c);
+		_mm256_stream_si256((__m256i *)(d + 96), e);
+	}
+
+	for (; size >= 32; size -= 32, s += 32, d += 32)
+		_mm256_stream_si256((__m256i *)d,
+				    _mm256_loadu_si256((const __m256i *)s));
+
+	memcpy(d, s, size);
+}
+
+#endif /* __x86_64__ || __i386__ */
+
+static void
+amdgpu_copy_to_wc_memcpy(void *dst, const void *src, size_t size)
+{
+	memcpy(dst, src, size);
+}
+
+static void (*amdgpu_copy_to_wc_func)(void *dst, const void *src,
+				      size_t size) = amdgpu_copy_to_wc_memcpy;
+static int amdgpu_copy_streaming;
+
+void
+amdgpu_copy_init(void)
+{
+#ifdef AMDGPU_COPY_STREAMING
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		amdgpu_copy_to_wc_func = amdgpu_copy_to_wc_avx2;
+		amdgpu_copy_streaming = 1;
+	} else if (__builtin_cpu_supports("sse2")) {
+		amdgpu_copy_to_wc_func = amdgpu_copy_to_wc_sse2;
+		amdgpu_copy_streaming = 1;
+	}
+#endif
+}
+
+void
+amdgpu_copy_to_wc(void *dst, const void *src, size_t size)
+{
+	amdgpu_copy_to_wc_func(dst, src, size);
+}
+
+#ifdef AMDGPU_COPY_STREAMING
+__attribute__((target("sse2")))
+#endif
+void
+amdgpu_copy_to_wc_finish(void)
+{
+#ifdef AMDGPU_COPY_STREAMING
+	/* Make the non-temporal stores globally visible */
+	if (amdgpu_copy_streaming)
+		_mm_sfence();
+#endif
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright © 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef AMDGPU_COPY_H
+#define AMDGPU_COPY_H
+
+#include <stddef.h>
+
+/* Select the copy implementation for the CPU, must be called before
+ * amdgpu_copy_to_wc
+ */
+void amdgpu_copy_init(void);
+
+/* Copy to write-combined memory, bypassing the CPU caches where possible.
+ * amdgpu_copy_to_wc_finish must be called on the same thread after the last
+ * copy, before the destination is consumed by the GPU or display engine.
+ */
+void amdgpu_copy_to_wc(void *dst, const void *src, size_t size);
+void amdgpu_copy_to_wc_finish(void);
+
+#endif /* AMDGPU_COPY_H */
@@ -677,6 +677,7 @@ amdgpu_dri2_exchange_buffers(DrawablePtr draw, DRI2BufferPtr front,
 	struct amdgpu_pixmap *front_pix;
 	struct amdgpu_pixmap *back_pix;
 	ScreenPtr screen;
+	ScrnInfoPtr scrn;
 	AMDGPUInfoPtr info;
 	RegionRec region;
 	int tmp;
@@ -700,7 +701,8 @@ amdgpu_dri2_exchange_buffers(DrawablePtr draw, DRI2BufferPtr front,
 
 	/* Do we need to update the Screen? */
 	screen = draw->pScreen;
-	info = AMDGPUPTR(xf86ScreenToScrn(screen));
+	scrn = xf86ScreenToScrn(screen);
+	info = AMDGPUPTR(scrn);
 	if (front_pix->bo == info->front_buffer) {
 		struct amdgpu_pixmap *screen_priv =
 			amdgpu_get_pixmap_private(screen->GetScreenPixmap(screen));
@@ -708,7 +710,25 @@ amdgpu_dri2_exchange_buffers(DrawablePtr draw, DRI2BufferPtr front,
 		amdgpu_bo_ref(back_pix->bo);
 		amdgpu_bo_unref(&info->front_buffer);
 		info->front_buffer = back_pix->bo;
-		*screen_priv = *back_pix;
+
+		/* Copy the fields describing the storage explicitly: the FB
+		 * list link and the cached export fds stay owned by back_pix
+		 */
+		amdgpu_pixmap_invalidate_export(screen_priv);
+		screen_priv->gpu_read = back_pix->gpu_read;
+		screen_priv->gpu_write = back_pix->gpu_write;
+		screen_priv->tiling_info = back_pix->tiling_info;
+		screen_priv->bo = back_pix->bo;
+		screen_priv->fb_failed = back_pix->fb_failed;
+		screen_priv->handle_valid = back_pix->handle_valid;
+		screen_priv->handle = back_pix->handle;
+
+		drmmode_fb_reference(AMDGPUEntPriv(scrn)->fd, &screen_priv->fb,
+				     back_pix->fb);
+		if (screen_priv->fb)
+			amdgpu_pixmap_track_fb(scrn, screen_priv);
+		else
+			amdgpu_pixmap_untrack_fb(screen_priv);
 	}
 
 	amdgpu_glamor_exchange_buffers(front_priv->pixmap, back_priv->pixmap);
@@ -40,6 +40,7 @@
 #include <amdgpu_drm.h>
 #include <unistd.h>
 #include <poll.h>
+#include <sys/eventfd.h>
 
 /* DRI3 Sync Object support (version 1.4) */
 
@@ -151,31 +152,37 @@ amdgpu_dri3_syncobj_free(struct dri3_syncobj *syncobj)
     free(amdgpu_syncobj);
 }
 
-static Bool
-amdgpu_dri3_syncobj_has_fence(struct dri3_syncobj *syncobj, uint64_t point)
+/*
+ * Waits for a timeline point without blocking. Returns 0 if the condition
+ * given by flags is already met.
+ */
+static int
+amdgpu_dri3_syncobj_poll(struct amdgpu_dri3_syncobj *amdgpu_syncobj,
+                         uint64_t point, uint32_t flags)
 {
-    struct amdgpu_dri3_syncobj *amdgpu_syncobj =
-        (struct amdgpu_dri3_syncobj *)syncobj;
-    ScrnInfoPtr scrn = xf86ScreenToScrn(syncobj->screen);
+    ScrnInfoPtr scrn = xf86ScreenToScrn(amdgpu_syncobj->base.screen);
     AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(scrn);
-    struct drm_syncobj_handle handle_args = { 0 };
-    int ret;
+    struct drm_syncobj_timeline_wait wait_args = { 0 };
 
-    (void)point;
+    wait_args.handles = (uint64_t)(uintptr_t)&amdgpu_syncobj->syncobj_handle;
+    wait_args.points = (uint64_t)(uintptr_t)&point;
+    wait_args.count_handles = 1;
+    wait_args.timeout_nsec = 0;  /* Non-blocking */
+    wait_args.flags = flags;
 
-    /* Try to export the syncobj to see if it has a fence */
-    handle_args.handle = amdgpu_syncobj->syncobj_handle;
-    handle_args.flags = DRM_SYNCOBJ_HANDLE_TO_FD_FLAGS_EXPORT_SYNC_FILE;
-    handle_args.fd = -1;
+    return drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_TIMELINE_WAIT,
+                    &wait_args);
+}
 
-    ret = drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_HANDLE_TO_FD, &handle_args);
-    if (ret == 0) {
-        /* Has a fence, close the fd we just got */
-        close(handle_args.fd);
-        return TRUE;
-    }
+static Bool
+amdgpu_dri3_syncobj_has_fence(struct dri3_syncobj *syncobj, uint64_t point)
+{
+    struct amdgpu_dri3_syncobj *amdgpu_syncobj =
+        (struct amdgpu_dri3_syncobj *)syncobj;
 
-    return FALSE;
+    return amdgpu_dri3_syncobj_poll(amdgpu_syncobj, point,
+                                    DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT |
+                                    DRM_SYNCOBJ_WAIT_FLAGS_WAIT_AVAILABLE) == 0;
 }
 
 static Bool
@@ -183,30 +190,47 @@ amdgpu_dri3_syncobj_is_signaled(struct dri3_syncobj *syncobj, uint64_t point)
 {
     struct amdgpu_dri3_syncobj *amdgpu_syncobj =
         (struct amdgpu_dri3_syncobj *)syncobj;
-    ScrnInfoPtr scrn = xf86ScreenToScrn(syncobj->screen);
-    AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(scrn);
-    struct drm_syncobj_wait wait_args;
-    int ret;
 
-    /* Set up wait args for non-blocking check */
-    wait_args.handles = (uint64_t)(uintptr_t)&amdgpu_syncobj->syncobj_handle;
-    wait_args.count_handles = 1;
-    wait_args.timeout_nsec = 0;  /* Non-blocking */
-    wait_args.flags = 0;
-    wait_args.first_signaled = 0;
-    wait_args.pad = 0;
+    return amdgpu_dri3_syncobj_poll(amdgpu_syncobj, point,
+                                    DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT) == 0;
+}
 
-    (void)point;
+/*
+ * Creates a binary syncobj for converting between timeline points and sync
+ * files, which can only be done with binary syncobjs. Returns 0 on failure.
+ */
+static uint32_t
+amdgpu_dri3_syncobj_create_temp(int fd)
+{
+    struct drm_syncobj_create create_args = { 0 };
+
+    if (drmIoctl(fd, DRM_IOCTL_SYNCOBJ_CREATE, &create_args) != 0)
+        return 0;
+
+    return create_args.handle;
+}
+
+static void
+amdgpu_dri3_syncobj_destroy_temp(int fd, uint32_t handle)
+{
+    struct drm_syncobj_destroy destroy_args = { .handle = handle };
+
+    drmIoctl(fd, DRM_IOCTL_SYNCOBJ_DESTROY, &destroy_args);
+}
 
-    ret = drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_WAIT, &wait_args);
+/* Copies the fence of a point of one syncobj to a point of another one */
+static int
+amdgpu_dri3_syncobj_transfer(int fd, uint32_t dst_handle, uint64_t dst_point,
+                             uint32_t src_handle, uint64_t src_point)
+{
+    struct drm_syncobj_transfer transfer_args = {
+        .src_handle = src_handle,
+        .dst_handle = dst_handle,
+        .src_point = src_point,
+        .dst_point = dst_point,
+    };
 
-    /* Return TRUE if wait succeeded (fence is signaled) or ioctl failed in a way
-     * that indicates the fence is not present (ENOENT means handle not found) */
-    if (ret == 0)
-        return TRUE;  /* signaled */
-    if (ret == -1 && (errno == ENOENT || errno == EINVAL))
-        return TRUE;  /* no fence means signaled */
-    return FALSE;  /* not signaled */
+    return drmIoctl(fd, DRM_IOCTL_SYNCOBJ_TRANSFER, &transfer_args);
 }
 
 static int
@@ -217,15 +241,26 @@ amdgpu_dri3_syncobj_export_fence(struct dri3_syncobj *syncobj, uint64_t point)
     ScrnInfoPtr scrn = xf86ScreenToScrn(syncobj->screen);
     AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(scrn);
     struct drm_syncobj_handle handle_args = { 0 };
+    uint32_t temp;
     int ret;
 
-    (void)point;
+    temp = amdgpu_dri3_syncobj_create_temp(pAMDGPUEnt->fd);
+    if (!temp)
+        return -1;
+
+    ret = amdgpu_dri3_syncobj_transfer(pAMDGPUEnt->fd, temp, 0,
+                                       amdgpu_syncobj->syncobj_handle, point);
+    if (ret == 0) {
+        handle_args.handle = temp;
+        handle_args.flags = DRM_SYNCOBJ_HANDLE_TO_FD_FLAGS_EXPORT_SYNC_FILE;
+        handle_args.fd = -1;
+
+        ret = drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_HANDLE_TO_FD,
+                       &handle_args);
+    }
 
-    handle_args.handle = amdgpu_syncobj->syncobj_handle;
-    handle_args.flags = DRM_SYNCOBJ_HANDLE_TO_FD_FLAGS_EXPORT_SYNC_FILE;
-    handle_args.fd = -1;
+    amdgpu_dri3_syncobj_destroy_temp(pAMDGPUEnt->fd, temp);
 
-    ret = drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_HANDLE_TO_FD, &handle_args);
     if (ret != 0)
         return -1;
 
@@ -239,26 +274,29 @@ amdgpu_dri3_syncobj_import_fence(struct dri3_syncobj *syncobj, uint64_t point, i
         (struct amdgpu_dri3_syncobj *)syncobj;
     ScrnInfoPtr scrn = xf86ScreenToScrn(syncobj->screen);
     AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(scrn);
-    struct drm_syncobj_handle handle_args;
+    struct drm_syncobj_handle handle_args = { 0 };
+    uint32_t temp;
     int ret;
 
-    (void)point;
-
-    /* First reset the syncobj */
-    struct drm_syncobj_array reset_args = {
-        .handles = (uint64_t)(uintptr_t)&amdgpu_syncobj->syncobj_handle,
-        .count_handles = 1,
-    };
-    drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_RESET, &reset_args);
+    temp = amdgpu_dri3_syncobj_create_temp(pAMDGPUEnt->fd);
+    if (!temp) {
+        close(fd);
+        return;
+    }
 
-    /* Then import the fence fd into the syncobj */
-    memset(&handle_args, 0, sizeof(handle_args));
-    handle_args.handle = amdgpu_syncobj->syncobj_handle;
+    handle_args.handle = temp;
     handle_args.flags = DRM_SYNCOBJ_FD_TO_HANDLE_FLAGS_IMPORT_SYNC_FILE;
     handle_args.fd = fd;
 
     ret = drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_FD_TO_HANDLE, &handle_args);
-    (void)ret;
+    if (ret == 0) {
+        amdgpu_dri3_syncobj_transfer(pAMDGPUEnt->fd,
+                                     amdgpu_syncobj->syncobj_handle, point,
+                                     temp, 0);
+    }
+
+    close(fd);
+    amdgpu_dri3_syncobj_destroy_temp(pAMDGPUEnt->fd, temp);
 }
 
 static void
@@ -268,38 +306,62 @@ amdgpu_dri3_syncobj_signal(struct dri3_syncobj *syncobj, uint64_t point)
         (struct amdgpu_dri3_syncobj *)syncobj;
     ScrnInfoPtr scrn = xf86ScreenToScrn(syncobj->screen);
     AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(scrn);
-    struct drm_syncobj_array signal_args;
-
-    (void)point;
+    struct drm_syncobj_timeline_array signal_args = { 0 };
 
     signal_args.handles = (uint64_t)(uintptr_t)&amdgpu_syncobj->syncobj_handle;
+    signal_args.points = (uint64_t)(uintptr_t)&point;
     signal_args.count_handles = 1;
 
-    drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_SIGNAL, &signal_args);
+    drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_TIMELINE_SIGNAL, &signal_args);
+}
+
+/*
+ * Has the kernel signal an eventfd once the given point of the syncobj is
+ * signaled, or only once a fence for it is available with
+ * DRM_SYNCOBJ_WAIT_FLAGS_WAIT_AVAILABLE. The server watches the eventfd with
+ * SetNotifyFd, so it never needs to block or poll for the point.
+ */
+static void
+amdgpu_dri3_syncobj_eventfd(struct dri3_syncobj *syncobj, uint64_t point,
+                            int efd, uint32_t flags)
+{
+#ifdef DRM_IOCTL_SYNCOBJ_EVENTFD
+    struct amdgpu_dri3_syncobj *amdgpu_syncobj =
+        (struct amdgpu_dri3_syncobj *)syncobj;
+    ScrnInfoPtr scrn = xf86ScreenToScrn(syncobj->screen);
+    AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(scrn);
+    struct drm_syncobj_eventfd eventfd_args = { 0 };
+
+    eventfd_args.handle = amdgpu_syncobj->syncobj_handle;
+    eventfd_args.flags = flags;
+    eventfd_args.point = point;
+    eventfd_args.fd = efd;
+
+    if (drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_EVENTFD,
+                 &eventfd_args) == 0)
+        return;
+
+    xf86DrvMsg(scrn->scrnIndex, X_WARNING,
+               "DRM_IOCTL_SYNCOBJ_EVENTFD failed: %s\n", strerror(errno));
+#endif
+
+    /* Don't leave the server waiting forever */
+    eventfd_write(efd, 1);
 }
 
 static void
 amdgpu_dri3_syncobj_submitted_eventfd(struct dri3_syncobj *syncobj,
                                       uint64_t point, int efd)
 {
-    /* Called when client submits an eventfd for signaling notification.
-     * For AMDGPU, we handle this in the wait ioctl with eventfd support.
-     */
-    (void)syncobj;
-    (void)point;
-    (void)efd;
+    amdgpu_dri3_syncobj_eventfd(syncobj, point, efd,
+                                DRM_SYNCOBJ_WAIT_FLAGS_WAIT_AVAILABLE);
 }
 
 static void
 amdgpu_dri3_syncobj_signaled_eventfd(struct dri3_syncobj *syncobj,
                                        uint64_t point, int efd)
 {
-    /* Called when the syncobj has been signaled via eventfd.
-     * For AMDGPU, this is handled by the kernel's eventfd notification.
-     */
-    (void)syncobj;
-    (void)point;
-    (void)efd;
+    amdgpu_dri3_syncobj_eventfd(syncobj, point, efd, 0);
 }
 
 static struct dri3_syncobj *
@@ -309,47 +371,21 @@ amdgpu_dri3_import_syncobj(ClientPtr client, ScreenPtr screen,
     struct amdgpu_dri3_syncobj *amdgpu_syncobj;
     ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
     AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(scrn);
-    struct drm_syncobj_create create_args;
+    struct drm_syncobj_handle handle_args = { 0 };
     int ret;
 
-    /* Create a new syncobj */
-    create_args.handle = 0;
-    create_args.flags = 0;
-    ret = drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_CREATE, &create_args);
+    /* The client passes an fd referencing its syncobj */
+    handle_args.fd = fd;
+    ret = drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_FD_TO_HANDLE, &handle_args);
     if (ret != 0) {
         xf86DrvMsg(scrn->scrnIndex, X_WARNING,
-                   "Failed to create DRM syncobj: %s\n", strerror(errno));
+                   "Failed to import DRM syncobj: %s\n", strerror(errno));
         return NULL;
     }
 
-    /* Import the fence if provided */
-    if (fd >= 0) {
-        struct drm_syncobj_handle handle_args;
-
-        memset(&handle_args, 0, sizeof(handle_args));
-        handle_args.handle = create_args.handle;
-        handle_args.flags = DRM_SYNCOBJ_FD_TO_HANDLE_FLAGS_IMPORT_SYNC_FILE;
-        handle_args.fd = fd;
-
-        ret = drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_FD_TO_HANDLE, &handle_args);
-        if (ret != 0) {
-            xf86DrvMsg(scrn->scrnIndex, X_WARNING,
-                       "Failed to import fence into syncobj: %s\n",
-                       strerror(errno));
-            struct drm_syncobj_destroy destroy_args = {
-                .handle = create_args.handle
-            };
-            drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_DESTROY, &destroy_args);
-            return NULL;
-        }
-    }
-
     amdgpu_syncobj = calloc(1, sizeof(*amdgpu_syncobj));
     if (!amdgpu_syncobj) {
-        struct drm_syncobj_destroy destroy_args = {
-            .handle = create_args.handle
-        };
-        drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_DESTROY, &destroy_args);
+        amdgpu_dri3_syncobj_destroy_temp(pAMDGPUEnt->fd, handle_args.handle);
         return NULL;
     }
 
@@ -364,7 +400,7 @@ amdgpu_dri3_import_syncobj(ClientPtr client, ScreenPtr screen,
     amdgpu_syncobj->base.signal = amdgpu_dri3_syncobj_signal;
     amdgpu_syncobj->base.submitted_eventfd = amdgpu_dri3_syncobj_submitted_eventfd;
     amdgpu_syncobj->base.signaled_eventfd = amdgpu_dri3_syncobj_signaled_eventfd;
-    amdgpu_syncobj->syncobj_handle = create_args.handle;
+    amdgpu_syncobj->syncobj_handle = handle_args.handle;
     amdgpu_syncobj->owns_handle = TRUE;
 
     (void)client;
@@ -555,9 +591,13 @@ static PixmapPtr amdgpu_dri3_pixmap_from_fds(ScreenPtr screen,
 	PixmapPtr pixmap;
 	ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
 	AMDGPUInfoPtr info = AMDGPUPTR(scrn);
+	struct amdgpu_import_key key;
+	struct amdgpu_buffer *buffer = NULL;
+	struct amdgpu_pixmap *priv;
 	struct gbm_device *gbm;
 	struct gbm_bo *bo;
-	Bool ret;
+	Bool cacheable;
+	Bool has_modifier = FALSE;
 	int i;
 	uint32_t gbm_format;
 
@@ -577,9 +617,24 @@ static PixmapPtr amdgpu_dri3_pixmap_from_fds(ScreenPtr screen,
 	if (!gbm_format_from_depth(depth, &gbm_format))
 		goto error;
 
+	/* Reuse the BO if the same memory was imported before with the same
+	 * layout, and is still in use
+	 */
+	cacheable = amdgpu_import_key_init(&key, num_fds, fds, width, height,
+					   gbm_format, strides, offsets,
+					   modifier);
+	if (cacheable)
+		buffer = amdgpu_import_cache_lookup(&key,
+						    AMDGPUEntPriv(scrn)->fd);
+
+	if (buffer)
+		goto create_texture;
+
 #ifdef GBM_BO_IMPORT_FD_MODIFIER
-	/* Try multi-plane import with modifier first */
-	if (modifier != DRM_FORMAT_MOD_INVALID && num_fds > 1) {
+	/* Import with the explicit modifier, so that the FB created for
+	 * flipping uses the same layout, including any DCC planes
+	 */
+	if (modifier != DRM_FORMAT_MOD_INVALID) {
 		struct gbm_import_fd_modifier_data import_data = { 0 };
 
 		import_data.width = width;
@@ -594,13 +649,18 @@ static PixmapPtr amdgpu_dri3_pixmap_from_fds(ScreenPtr screen,
 		}
 		bo = gbm_bo_import(gbm, GBM_BO_IMPORT_FD_MODIFIER, &import_data,
 				  GBM_BO_USE_RENDERING);
+		has_modifier = TRUE;
 	} else
 #endif
 	{
-		/* Single plane or no modifier - use GBM_BO_IMPORT_FD */
+		/* No modifier - use GBM_BO_IMPORT_FD, which would lose any
+		 * modifier other than LINEAR
+		 */
 		struct gbm_import_fd_data import_data = { 0 };
 
-		if (num_fds != 1)
+		if (num_fds != 1 ||
+		    (modifier != DRM_FORMAT_MOD_INVALID &&
+		     modifier != DRM_FORMAT_MOD_LINEAR))
 			goto error;
 
 		import_data.fd = fds[0];
@@ -613,25 +673,47 @@ static PixmapPtr amdgpu_dri3_pixmap_from_fds(ScreenPtr screen,
 				  GBM_BO_USE_RENDERING);
 	}
 
-	if (bo) {
-		screen->ModifyPixmapHeader(pixmap, width, height, 0, 0, strides[0], NULL);
-		ret = glamor_egl_create_textured_pixmap_from_gbm_bo(pixmap, bo, FALSE);
+	if (!bo)
+		goto error;
+
+	/* Keep the GBM BO around, so that the GEM handle and tiling metadata
+	 * can be cached in it
+	 */
+	buffer = calloc(1, sizeof(*buffer));
+	if (!buffer) {
 		gbm_bo_destroy(bo);
-		if (ret) {
-			struct amdgpu_pixmap *priv = calloc(1, sizeof(*priv));
+		goto error;
+	}
 
-			if (priv) {
-				amdgpu_set_pixmap_private(pixmap, priv);
-				pixmap->usage_hint |= AMDGPU_CREATE_PIXMAP_DRI2;
-				return pixmap;
-			}
+	buffer->bo.gbm = bo;
+	buffer->ref_count = 1;
+	buffer->flags = AMDGPU_BO_FLAGS_GBM;
+	if (has_modifier)
+		buffer->flags |= AMDGPU_BO_FLAGS_MODIFIER;
+	xorg_list_init(&buffer->cpu_map_lru);
+
+	if (cacheable)
+		amdgpu_import_cache_add(buffer, &key, AMDGPUEntPriv(scrn)->fd);
+
+create_texture:
+	screen->ModifyPixmapHeader(pixmap, width, height, 0, 0, strides[0], NULL);
+	if (!glamor_egl_create_textured_pixmap_from_gbm_bo(pixmap,
+							   buffer->bo.gbm,
+							   FALSE))
+		goto error;
 
-			screen->DestroyPixmap(pixmap);
-			return NULL;
-		}
-	}
+	priv = calloc(1, sizeof(*priv));
+	if (!priv)
+		goto error;
+
+	priv->bo = buffer;
+	amdgpu_set_pixmap_private(pixmap, priv);
+	pixmap->usage_hint |= AMDGPU_CREATE_PIXMAP_DRI2;
+	return pixmap;
 
 error:
+	if (buffer)
+		amdgpu_bo_unref(&buffer);
 	if (pixmap)
 		dixDestroyPixmap(pixmap, 0);
 	return NULL;
@@ -672,55 +754,98 @@ free_pixmap:
 	return NULL;
 }
 
-static int amdgpu_dri3_fd_from_pixmap(ScreenPtr screen,
-				      PixmapPtr pixmap,
-				      CARD16 *stride,
-				      CARD32 *size)
+/* Returns the driver private of a pixmap, allocating it if necessary */
+static struct amdgpu_pixmap *
+amdgpu_dri3_get_pixmap_private(PixmapPtr pixmap)
 {
-	struct amdgpu_buffer *bo;
-	struct amdgpu_bo_info bo_info;
-	uint32_t fd;
-	ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
-	AMDGPUInfoPtr info = AMDGPUPTR(scrn);
+	struct amdgpu_pixmap *priv = amdgpu_get_pixmap_private(pixmap);
 
-	if (info->use_glamor) {
-		int ret = glamor_fd_from_pixmap(screen, pixmap, stride, size);
+	if (!priv) {
+		priv = calloc(1, sizeof(*priv));
+		if (priv)
+			amdgpu_set_pixmap_private(pixmap, priv);
+	}
 
-		/* Any pending drawing operations need to be flushed to the
-		 * kernel driver before the client starts using the pixmap
-		 * storage for direct rendering.
-		 */
-		if (ret >= 0)
-			amdgpu_glamor_flush(scrn);
+	return priv;
+}
+
+/* Hands out duplicates of the cached export fds of a pixmap */
+static int
+amdgpu_dri3_dup_export(struct amdgpu_pixmap *priv, int *fds, uint32_t *strides,
+		       uint32_t *offsets, uint64_t *modifier)
+{
+	int i;
 
-		return ret;
+	for (i = 0; i < priv->num_export_fds; i++) {
+		fds[i] = fcntl(priv->export_fds[i], F_DUPFD_CLOEXEC, 0);
+		if (fds[i] < 0) {
+			while (i--)
+				close(fds[i]);
+			return 0;
+		}
+
+		strides[i] = priv->export_strides[i];
+		offsets[i] = priv->export_offsets[i];
 	}
 
-	bo = amdgpu_get_pixmap_bo(pixmap);
-	if (!bo)
-		return -1;
+	*modifier = priv->export_modifier;
+	return priv->num_export_fds;
+}
 
-	if (pixmap->devKind > UINT16_MAX)
-		return -1;
+/* Maximum number of pixmaps per screen with a cached export */
+#define AMDGPU_DRI3_EXPORT_CACHE_SIZE 64
 
-	if (amdgpu_bo_query_info(bo->bo.amdgpu, &bo_info) != 0)
-		return -1;
+/*
+ * Screen capture clients export the same pixmaps over and over, so keep a
+ * duplicate of the exported fds until the pixmap storage changes, see
+ * amdgpu_pixmap_invalidate_export. Only the most recently exported pixmaps
+ * keep their fds, so that e.g. compositors exporting every window pixmap
+ * can't make the server run out of fds.
+ */
+static void
+amdgpu_dri3_cache_export(ScrnInfoPtr scrn, struct amdgpu_pixmap *priv,
+			 int num_fds, const int *fds, const uint32_t *strides,
+			 const uint32_t *offsets, uint64_t modifier)
+{
+	AMDGPUInfoPtr info = AMDGPUPTR(scrn);
+	struct amdgpu_pixmap *lru, *tmp;
+	int num_cached = 0;
+	int i;
 
-	if (amdgpu_bo_export(bo->bo.amdgpu, amdgpu_bo_handle_type_dma_buf_fd,
-			     &fd) != 0)
-		return -1;
+	amdgpu_pixmap_invalidate_export(priv);
 
-	*stride = pixmap->devKind;
-	*size = bo_info.alloc_size;
-	return fd;
+	xorg_list_for_each_entry_safe(lru, tmp, &info->export_pixmaps,
+				      export_list) {
+		if (++num_cached >= AMDGPU_DRI3_EXPORT_CACHE_SIZE)
+			amdgpu_pixmap_invalidate_export(lru);
+	}
+
+	for (i = 0; i < num_fds; i++) {
+		priv->export_fds[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, 0);
+		if (priv->export_fds[i] < 0) {
+			while (i--)
+				close(priv->export_fds[i]);
+			return;
+		}
+
+		priv->export_strides[i] = strides[i];
+		priv->export_offsets[i] = offsets[i];
+	}
+
+	priv->export_modifier = modifier;
+	priv->num_export_fds = num_fds;
+	priv->export_bo = priv->bo;
+	xorg_list_add(&priv->export_list, &info->export_pixmaps);
 }
 
-static int amdgpu_dri3_fds_from_pixmap(ScreenPtr screen,
-				 PixmapPtr pixmap,
-				 int *fds,
-				 uint32_t *strides,
-				 uint32_t *offsets,
-				 uint64_t *modifier)
+/*
+ * Exports the pixmap storage, without using the cache. Returns the number of
+ * fds, 0 on failure.
+ */
+static int
+amdgpu_dri3_do_export(ScreenPtr screen, PixmapPtr pixmap, Bool modifiers_ok,
+		      int *fds, uint32_t *strides, uint32_t *offsets,
+		      uint64_t *modifier, uint32_t *size)
 {
 	struct amdgpu_buffer *bo;
 	struct amdgpu_bo_info bo_info;
@@ -728,49 +853,47 @@ static int amdgpu_dri3_fds_from_pixmap(ScreenPtr screen,
 	ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
 	AMDGPUInfoPtr info = AMDGPUPTR(scrn);
 
+	*size = 0;
+
 	if (info->use_glamor) {
-		/* For glamor, we need to get the GBM BO to extract modifier info */
 		CARD16 stride16;
-		CARD32 size;
+		CARD32 size32;
 		int ret;
 
-		ret = glamor_fd_from_pixmap(screen, pixmap, &stride16, &size);
+		if (modifiers_ok)
+			return glamor_fds_from_pixmap(screen, pixmap, fds, strides,
+						      offsets, modifier);
+
+		ret = glamor_fd_from_pixmap(screen, pixmap, &stride16, &size32);
 		if (ret < 0)
-			return -1;
+			return 0;
 
 		fds[0] = ret;
 		strides[0] = stride16;
 		offsets[0] = 0;
-
-		/* Flush any pending drawing operations */
-		amdgpu_glamor_flush(scrn);
-
-		/* Try to get the modifier from the pixmap's GBM BO.
-		 * Note: This is a best-effort attempt since glamor_fd_from_pixmap
-		 * doesn't expose the GBM BO directly.
-		 */
 		*modifier = DRM_FORMAT_MOD_INVALID;
-
+		*size = size32;
 		return 1;
 	}
 
 	bo = amdgpu_get_pixmap_bo(pixmap);
 	if (!bo)
-		return -1;
+		return 0;
 
 	if (pixmap->devKind > UINT32_MAX)
-		return -1;
+		return 0;
 
 	if (amdgpu_bo_query_info(bo->bo.amdgpu, &bo_info) != 0)
-		return -1;
+		return 0;
 
 	if (amdgpu_bo_export(bo->bo.amdgpu, amdgpu_bo_handle_type_dma_buf_fd,
 			     &fd) != 0)
-		return -1;
+		return 0;
 
 	fds[0] = fd;
 	strides[0] = pixmap->devKind;
 	offsets[0] = 0;
+	*size = bo_info.alloc_size;
 
 	/* Extract modifier from tiling_info for non-GBM buffers,
 	 * or use GBM BO modifier for GBM buffers.
@@ -791,6 +914,165 @@ static int amdgpu_dri3_fds_from_pixmap(ScreenPtr screen,
 	return 1;
 }
 
+/*
+ * Exports the pixmap storage, reusing the cached export if possible. Unless
+ * modifiers_ok is TRUE, the export must be a single plane with an implicit
+ * modifier.
+ */
+static int
+amdgpu_dri3_export(ScreenPtr screen, PixmapPtr pixmap, Bool modifiers_ok,
+		   int *fds, uint32_t *strides, uint32_t *offsets,
+		   uint64_t *modifier, uint32_t *size)
+{
+	ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
+	AMDGPUInfoPtr info = AMDGPUPTR(scrn);
+	struct amdgpu_pixmap *priv = amdgpu_dri3_get_pixmap_private(pixmap);
+	int num_fds;
+
+	/* The cached export is stale if the pixmap has a different BO now */
+	if (priv && priv->num_export_fds > 0 && priv->export_bo != priv->bo)
+		amdgpu_pixmap_invalidate_export(priv);
+
+	/* Without glamor, there's only ever a single plane, and its layout
+	 * doesn't depend on whether the client supports modifiers
+	 */
+	if (priv && priv->num_export_fds > 0 &&
+	    (modifiers_ok || !info->use_glamor ||
+	     (priv->num_export_fds == 1 && priv->export_offsets[0] == 0 &&
+	      priv->export_modifier == DRM_FORMAT_MOD_INVALID))) {
+		num_fds = amdgpu_dri3_dup_export(priv, fds, strides, offsets,
+						 modifier);
+		xorg_list_del(&priv->export_list);
+		xorg_list_add(&priv->export_list, &info->export_pixmaps);
+		if (num_fds > 0 && size) {
+			if (priv->export_size == 0) {
+				off_t end = lseek(priv->export_fds[0], 0,
+						  SEEK_END);
+
+				if (end > 0 && end <= UINT32_MAX)
+					priv->export_size = end;
+			}
+
+			*size = priv->export_size;
+		}
+	} else {
+		uint32_t export_size;
+
+		num_fds = amdgpu_dri3_do_export(screen, pixmap, modifiers_ok,
+						fds, strides, offsets, modifier,
+						&export_size);
+		if (num_fds > 0 && priv) {
+			amdgpu_dri3_cache_export(scrn, priv, num_fds, fds,
+						 strides, offsets, *modifier);
+			priv->export_size = export_size;
+		}
+
+		if (size)
+			*size = export_size;
+	}
+
+	/* Any pending drawing operations need to be flushed to the
+	 * kernel driver before the client starts using the pixmap
+	 * storage for direct rendering.
+	 */
+	if (num_fds > 0 && info->use_glamor)
+		amdgpu_glamor_flush(scrn);
+
+	return num_fds;
+}
+
+static int amdgpu_dri3_fd_from_pixmap(ScreenPtr screen,
+				      PixmapPtr pixmap,
+				      CARD16 *stride,
+				      CARD32 *size)
+{
+	uint32_t strides[4], offsets[4];
+	uint64_t modifier;
+	int fds[4];
+
+	if (amdgpu_dri3_export(screen, pixmap, FALSE, fds, strides, offsets,
+			       &modifier, size) != 1)
+		return -1;
+
+	if (strides[0] > UINT16_MAX) {
+		close(fds[0]);
+		return -1;
+	}
+
+	*stride = strides[0];
+	return fds[0];
+}
+
+static int amdgpu_dri3_fds_from_pixmap(ScreenPtr screen,
+				 PixmapPtr pixmap,
+				 int *fds,
+				 uint32_t *strides,
+				 uint32_t *offsets,
+				 uint64_t *modifier)
+{
+	return amdgpu_dri3_export(screen, pixmap, TRUE, fds, strides, offsets,
+				  modifier, NULL);
+}
+
+/*
+ * Returns whether GBM can handle buffers with the given format and modifier.
+ * There's no point advertising combinations which can't be imported.
+ */
+static Bool
+amdgpu_dri3_gbm_supports(AMDGPUInfoPtr info, uint32_t format,
+			 uint64_t modifier)
+{
+	if (!info->gbm)
+		return TRUE;
+
+	if (!gbm_device_is_format_supported(info->gbm, format,
+					    GBM_BO_USE_RENDERING))
+		return FALSE;
+
+#if HAVE_GBM_DEVICE_GET_FORMAT_MODIFIER_PLANE_COUNT
+	return gbm_device_get_format_modifier_plane_count(info->gbm, format,
+							  modifier) > 0;
+#else
+	return TRUE;
+#endif
+}
+
+/*
+ * Returns a newly allocated array of the modifiers of a plane format which
+ * GBM supports as well, and the number of entries in it
+ */
+static uint32_t
+amdgpu_dri3_filter_modifiers(AMDGPUInfoPtr info, struct drmmode_format *fmt,
+			     uint64_t **modifiers)
+{
+	uint32_t i, num = 0;
+
+	*modifiers = NULL;
+	if (fmt->num_modifiers == 0)
+		return 0;
+
+	*modifiers = malloc(fmt->num_modifiers * sizeof(**modifiers));
+	if (!*modifiers)
+		return 0;
+
+	for (i = 0; i < fmt->num_modifiers; i++) {
+		if (amdgpu_dri3_gbm_supports(info, fmt->format,
+					     fmt->modifiers[i]))
+			(*modifiers)[num++] = fmt->modifiers[i];
+	}
+
+	if (num == 0) {
+		free(*modifiers);
+		*modifiers = NULL;
+	}
+
+	return num;
+}
+
+/*
+ * Returns the formats supported by the primary and overlay planes of the
+ * screen's CRTCs, which GBM supports as well
+ */
 static int
 amdgpu_dri3_get_formats(ScreenPtr screen, unsigned int *num_formats,
 		    unsigned int **formats)
@@ -830,21 +1112,54 @@ amdgpu_dri3_get_formats(ScreenPtr screen, unsigned int *num_formats,
 		DRM_FORMAT_BGR233,
 	};
 
-	*num_formats = sizeof(formats_arr) / sizeof(formats_arr[0]);
-	*formats = (unsigned int *)formats_arr;
-	return sizeof(formats_arr) / sizeof(formats_arr[0]);
+	ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
+	AMDGPUInfoPtr info = AMDGPUPTR(scrn);
+	drmmode_ptr drmmode = &info->drmmode;
+	struct drmmode_format *fmt;
+	uint32_t i, j, num = 0;
+
+	*num_formats = 0;
+
+	if (drmmode->num_formats == 0) {
+		/* The kernel doesn't tell us, fall back to a fixed list */
+		*formats = malloc(sizeof(formats_arr));
+		if (!*formats)
+			return 0;
+
+		memcpy(*formats, formats_arr, sizeof(formats_arr));
+		*num_formats = sizeof(formats_arr) / sizeof(formats_arr[0]);
+		return *num_formats;
+	}
+
+	*formats = malloc(drmmode->num_formats * sizeof(**formats));
+	if (!*formats)
+		return 0;
+
+	for (i = 0; i < drmmode->num_formats; i++) {
+		fmt = &drmmode->formats[i];
+
+		for (j = 0; j < fmt->num_modifiers; j++) {
+			if (amdgpu_dri3_gbm_supports(info, fmt->format,
+						     fmt->modifiers[j])) {
+				(*formats)[num++] = fmt->format;
+				break;
+			}
+		}
+	}
+
+	*num_formats = num;
+	return num;
 }
 
 /*
- * Returns supported modifiers for a given format.
- * This includes LINEAR (DRM_FORMAT_MOD_INVALID) and AMD-specific tiled modifiers.
+ * Returns the modifiers advertised when the kernel doesn't report which ones
+ * the display hardware supports. This includes LINEAR
+ * (DRM_FORMAT_MOD_INVALID) and AMD-specific tiled modifiers.
  */
 static int
-amdgpu_dri3_get_modifiers(ScreenPtr screen, uint32_t format,
-			   uint32_t *num_modifiers, uint64_t **modifiers)
+amdgpu_dri3_get_default_modifiers(AMDGPUInfoPtr info, uint32_t *num_modifiers,
+				  uint64_t **modifiers)
 {
-	ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
-	AMDGPUInfoPtr info = AMDGPUPTR(scrn);
 	static uint64_t default_modifiers[] = {
 		/* LINEAR - no tiling */
 		DRM_FORMAT_MOD_INVALID,
@@ -920,87 +1235,68 @@ amdgpu_dri3_get_modifiers(ScreenPtr screen, uint32_t format,
 	return count;
 }
 
-static Bool
-amdgpu_dri3_get_drawable_modifiers(DrawablePtr draw, uint32_t format,
-				   uint32_t *num_modifiers, uint64_t **modifiers)
+/*
+ * Returns the modifiers supported for the given format by any of the planes
+ * of the screen's CRTCs, which GBM supports as well
+ */
+static int
+amdgpu_dri3_get_modifiers(ScreenPtr screen, uint32_t format,
+			   uint32_t *num_modifiers, uint64_t **modifiers)
 {
-	ScrnInfoPtr scrn;
-	AMDGPUInfoPtr info;
-	uint64_t *mods;
-	uint32_t count;
-	int asic_family;
+	ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
+	AMDGPUInfoPtr info = AMDGPUPTR(scrn);
+	drmmode_ptr drmmode = &info->drmmode;
+	struct drmmode_format *fmt;
 
-	/* Validate input parameters */
-	if (!draw || !draw->pScreen || !num_modifiers || !modifiers)
-		return FALSE;
+	*num_modifiers = 0;
+	*modifiers = NULL;
 
-	scrn = xf86ScreenToScrn(draw->pScreen);
-	if (!scrn)
-		return FALSE;
+	if (drmmode->num_formats == 0)
+		return amdgpu_dri3_get_default_modifiers(info, num_modifiers,
+							 modifiers);
 
-	info = AMDGPUPTR(scrn);
-	if (!info)
-		return FALSE;
+	fmt = drmmode_find_format(drmmode->formats, drmmode->num_formats,
+				  format);
+	if (!fmt)
+		return 0;
 
-	asic_family = info->family;
+	*num_modifiers = amdgpu_dri3_filter_modifiers(info, fmt, modifiers);
+	return *num_modifiers;
+}
 
-	/* Determine which set of modifiers to return based on ASIC family.
-	 * For drawables, we return the same modifiers as screen-level modifiers.
-	 */
-	if (asic_family >= AMDGPU_FAMILY_GC_12_0_0) {
-#ifdef HAVE_AMD_FMT_MOD_TILE_VER_GFX12
-		static uint64_t gfx12_mods[] = {
-			DRM_FORMAT_MOD_INVALID,
-			AMD_FMT_MOD | AMD_FMT_MOD_TILE_VER_GFX12 |
-				AMD_FMT_MOD_TILE_GFX12_64K_2D,
-		};
-		mods = gfx12_mods;
-		count = sizeof(gfx12_mods) / sizeof(gfx12_mods[0]);
-#else
-		/* GFX12 not supported, fall back to invalid modifier */
-		static uint64_t invalid_mods[] = { DRM_FORMAT_MOD_INVALID };
-		mods = invalid_mods;
-		count = 1;
-#endif
-	} else if (asic_family >= AMDGPU_FAMILY_NV) {
-		/* Navi and newer (GFX10+) */
-		static uint64_t gfx10_mods[] = {
-			DRM_FORMAT_MOD_INVALID,
-			AMD_FMT_MOD | AMD_FMT_MOD_TILE_VER_GFX10 |
-				AMD_FMT_MOD_TILE_GFX9_64K_S,
-			AMD_FMT_MOD | AMD_FMT_MOD_TILE_VER_GFX10 |
-				AMD_FMT_MOD_TILE_GFX9_64K_D,
-		};
-		mods = gfx10_mods;
-		count = sizeof(gfx10_mods) / sizeof(gfx10_mods[0]);
-	} else if (asic_family >= AMDGPU_FAMILY_AI) {
-		/* Vega and newer (GFX9+) */
-		static uint64_t gfx9_mods[] = {
-			DRM_FORMAT_MOD_INVALID,
-			AMD_FMT_MOD | AMD_FMT_MOD_TILE_VER_GFX9 |
-				AMD_FMT_MOD_TILE_GFX9_64K_S,
-			AMD_FMT_MOD | AMD_FMT_MOD_TILE_VER_GFX9 |
-				AMD_FMT_MOD_TILE_GFX9_64K_D,
-		};
-		mods = gfx9_mods;
-		count = sizeof(gfx9_mods) / sizeof(gfx9_mods[0]);
-	} else {
-		/* For older chips, only support LINEAR */
-		static uint64_t default_mods[] = {
-			DRM_FORMAT_MOD_INVALID,
-		};
-		mods = default_mods;
-		count = sizeof(default_mods) / sizeof(default_mods[0]);
-	}
+/*
+ * Returns the modifiers which allow a window's buffers to be scanned out
+ * directly by page flipping, i.e. those supported by the primary plane of the
+ * CRTC the window is displayed on. No modifiers are returned if this can't be
+ * determined, in which case the client uses the screen modifiers.
+ */
+Bool
+amdgpu_dri3_get_drawable_modifiers(DrawablePtr draw, uint32_t format,
+				   uint32_t *num_modifiers, uint64_t **modifiers)
+{
+	ScrnInfoPtr scrn = xf86ScreenToScrn(draw->pScreen);
+	AMDGPUInfoPtr info = AMDGPUPTR(scrn);
+	drmmode_crtc_private_ptr drmmode_crtc;
+	struct drmmode_format *fmt;
+	RRCrtcPtr crtc;
 
-	/* Allocate and copy modifiers */
-	*modifiers = malloc(count * sizeof(uint64_t));
-	if (!*modifiers)
-		return FALSE;
+	*num_modifiers = 0;
+	*modifiers = NULL;
 
-	memcpy(*modifiers, mods, count * sizeof(uint64_t));
-	*num_modifiers = count;
+	if (draw->type != DRAWABLE_WINDOW)
+		return TRUE;
+
+	crtc = amdgpu_randr_crtc_covering_drawable(draw);
+	if (!crtc || crtc->pScreen != draw->pScreen)
+		return TRUE;
 
+	drmmode_crtc = ((xf86CrtcPtr)crtc->devPrivate)->driver_private;
+	fmt = drmmode_find_format(drmmode_crtc->formats,
+				  drmmode_crtc->num_formats, format);
+	if (!fmt)
+		return TRUE;
+
+	*num_modifiers = amdgpu_dri3_filter_modifiers(info, fmt, modifiers);
 	return TRUE;
 }
 
@@ -1029,6 +1325,12 @@ amdgpu_dri3_screen_init(ScreenPtr screen)
 
 	pAMDGPUEnt->render_node = drmGetRenderDeviceNameFromFd(pAMDGPUEnt->fd);
 
+	/* Explicit sync requires the kernel to signal eventfds for syncobjs,
+	 * see amdgpu_present_has_syncobj
+	 */
+	amdgpu_dri3_screen_info.import_syncobj =
+		AMDGPUPTR(scrn)->explicit_sync ? amdgpu_dri3_import_syncobj : NULL;
+
 	if (!dri3_screen_init(screen, &amdgpu_dri3_screen_info)) {
 		xf86DrvMsg(scrn->scrnIndex, X_WARNING,
 			   "dri3_screen_init failed\n");
@@ -69,6 +69,7 @@
 
 #include "damage.h"
 #include "globals.h"
+#include "list.h"
 
 #include "xf86Crtc.h"
 #include "X11/Xatom.h"
@@ -114,6 +115,8 @@ typedef enum {
 	OPTION_DELETE_DP12,
 	OPTION_VARIABLE_REFRESH,
 	OPTION_ASYNC_FLIP_SECONDARIES,
+	OPTION_VRAM_PRESSURE_THRESHOLD,
+	OPTION_CURSOR_CACHE_SIZE,
 } AMDGPUOpts;
 
 static inline ScreenPtr
@@ -154,6 +157,12 @@ amdgpu_dirty_src_equals(PixmapDirtyUpdatePtr dirty, PixmapPtr pixmap)
 
 #define AMDGPU_LOGLEVEL_DEBUG 4
 
+/* Reasons for deferred flushes, see amdgpu_glamor_flush_later */
+enum amdgpu_flush_reason {
+	AMDGPU_FLUSH_PRIME,		/* PRIME / pixmap dirty tracking updates */
+	AMDGPU_FLUSH_NUM_REASONS
+};
+
 /* Other macros */
 #define AMDGPU_ALIGN(x,bytes) (((x) + ((bytes) - 1)) & ~((bytes) - 1))
 #define AMDGPUPTR(pScrn)      ((AMDGPUInfoPtr)(pScrn)->driverPrivate)
@@ -164,7 +173,10 @@ amdgpu_dirty_src_equals(PixmapDirtyUpdatePtr dirty, PixmapPtr pixmap)
 #define CURSOR_WIDTH_CIK	128
 #define CURSOR_HEIGHT_CIK	128
 
-#define AMDGPU_BO_FLAGS_GBM	0x1
+#define AMDGPU_BO_FLAGS_GBM		0x1
+#define AMDGPU_BO_FLAGS_HANDLE_VALID	0x2
+#define AMDGPU_BO_FLAGS_TILING_VALID	0x4
+#define AMDGPU_BO_FLAGS_MODIFIER	0x8
 
 struct amdgpu_buffer {
 	union {
@@ -174,6 +186,21 @@ struct amdgpu_buffer {
 	void *cpu_ptr;
 	uint32_t ref_count;
 	uint32_t flags;
+	/* Persistent CPU mapping state, see amdgpu_bo_map(). cpu_map_lru must
+	 * be initialized wherever an amdgpu_buffer is created
+	 */
+	uint32_t cpu_map_count;
+	uint32_t cpu_map_size;
+	struct xorg_list cpu_map_lru;
+	/* Memory accounting state, see amdgpu_alloc_pixmap_bo() */
+	struct amdgpu_mem_stats *mem_stats;
+	enum amdgpu_mem_domain mem_domain;
+	uint64_t mem_size;
+	/* Cached GEM handle and tiling metadata, see amdgpu_pixmap_get_handle() */
+	uint32_t handle;
+	uint64_t tiling_info;
+	/* Import cache entry for dma-buf imports, see amdgpu_import_cache_add() */
+	struct amdgpu_import *import;
 };
 
 struct amdgpu_client_priv {
@@ -202,6 +229,7 @@ typedef struct {
 
 	void (*CreateFence) (ScreenPtr pScreen, struct _SyncFence *pFence,
 			     Bool initially_triggered);
+	void (*DestroyFence) (ScreenPtr pScreen, struct _SyncFence *pFence);
 
 	int pix24bpp;		/* Depth of pixmap for 24bpp fb      */
 	Bool dac6bits;		/* Use 6 bit DAC?                    */
@@ -215,6 +243,9 @@ typedef struct {
 	int callback_event_type;
 	uint_fast32_t gpu_flushed;
 	uint_fast32_t gpu_synced;
+	unsigned flush_pending;	/* Mask of enum amdgpu_flush_reason bits */
+	uint64_t flush_requests[AMDGPU_FLUSH_NUM_REASONS];
+	uint64_t flushes_avoided;
 	Bool use_glamor;
 	Bool force_accel;
 	Bool shadow_primary;
@@ -239,9 +270,17 @@ typedef struct {
 	Bool shadow_fb;
 	void *fb_shadow;
 	struct amdgpu_buffer *front_buffer;
+	/* Pixmaps which hold an FB, see amdgpu_pixmap_track_fb() */
+	struct xorg_list fb_pixmaps;
+	/* Pixmaps with a cached DRI3 export, most recently used first */
+	struct xorg_list export_pixmaps;
 
 	uint64_t vram_size;
 	uint64_t gart_size;
+	/* Percentage of VRAM in use above which non-scanout pixmaps are
+	 * allocated in GTT, 0 to disable
+	 */
+	int vram_pressure_threshold;
 	drmmode_rec drmmode;
 	Bool drmmode_inited;
 	/* r6xx+ tile config */
@@ -252,11 +291,14 @@ typedef struct {
 	WindowPtr flip_window;
 	Bool allowPageFlip;
 	Bool can_async_flip;
+	Bool explicit_sync;
 	Bool async_flip_secondaries;
 
 	/* cursor size */
 	int cursor_w;
 	int cursor_h;
+	/* Maximum number of cursor BOs per CRTC */
+	int cursor_cache_size;
 
 	/* If bit n of this field is set, xf86_config->crtc[n] currently can't
 	 * use the HW cursor
@@ -286,6 +328,13 @@ typedef struct {
 		SetSharedPixmapBackingProcPtr SavedSetSharedPixmapBacking;
 	} glamor;
 
+	/* GTT staging copy of the screen pixmap for GetImage */
+	struct {
+		PixmapPtr pixmap;
+		DamagePtr damage;
+		GetImageProcPtr SavedGetImage;
+	} capture;
+
 	xf86CrtcFuncsRec drmmode_crtc_funcs;
 } AMDGPUInfoRec, *AMDGPUInfoPtr;
 
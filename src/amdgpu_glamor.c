@@ -40,9 +40,17 @@ void amdgpu_glamor_exchange_buffers(PixmapPtr src, PixmapPtr dst)
 {
 	AMDGPUInfoPtr info = AMDGPUPTR(xf86ScreenToScrn(dst->drawable.pScreen));
 
+	struct amdgpu_pixmap *src_priv = amdgpu_get_pixmap_private(src);
+	struct amdgpu_pixmap *dst_priv = amdgpu_get_pixmap_private(dst);
+
 	if (!info->use_glamor)
 		return;
 	glamor_egl_exchange_buffers(src, dst);
+
+	if (src_priv)
+		amdgpu_pixmap_invalidate_export(src_priv);
+	if (dst_priv)
+		amdgpu_pixmap_invalidate_export(dst_priv);
 }
 
 Bool amdgpu_glamor_create_screen_resources(ScreenPtr screen)
@@ -319,6 +327,7 @@ amdgpu_glamor_share_pixmap_backing(PixmapPtr pixmap, ScreenPtr secondary,
 {
 	ScreenPtr screen = pixmap->drawable.pScreen;
 	AMDGPUInfoPtr info = AMDGPUPTR(xf86ScreenToScrn(screen));
+	struct amdgpu_pixmap *priv;
 	uint64_t tiling_info;
 	CARD16 stride;
 	CARD32 size;
@@ -358,6 +367,11 @@ amdgpu_glamor_share_pixmap_backing(PixmapPtr pixmap, ScreenPtr secondary,
 		amdgpu_glamor_set_pixmap_bo(&pixmap->drawable, linear);
 	}
 
+	/* glamor may reallocate the pixmap storage to make it exportable */
+	priv = amdgpu_get_pixmap_private(pixmap);
+	if (priv)
+		amdgpu_pixmap_invalidate_export(priv);
+
 	fd = glamor_fd_from_pixmap(screen, pixmap, &stride, &size);
 	if (fd < 0)
 		return FALSE;
@@ -395,6 +409,193 @@ amdgpu_glamor_set_shared_pixmap_backing(PixmapPtr pixmap, void *handle)
 }
 
 
+/*
+ * Screen capture readback
+ *
+ * Reading the screen pixmap back with glamor means a synchronous download
+ * from VRAM for every GetImage request. Capture clients (x11grab, VNC
+ * servers, ...) read the root window over and over, so instead we keep a
+ * linear copy of the screen pixmap in cacheable GTT memory, which stays
+ * mapped for its whole lifetime. Only the parts of the screen which were
+ * damaged since the last readback of the same area are copied by the GPU.
+ */
+
+/* Minimum GetImage size for allocating the staging pixmap */
+#define AMDGPU_CAPTURE_MIN_PIXELS (256 * 256)
+
+static void
+amdgpu_glamor_capture_damage_destroy(DamagePtr damage, void *closure)
+{
+	AMDGPUInfoPtr info = closure;
+
+	info->capture.damage = NULL;
+}
+
+static void
+amdgpu_glamor_capture_free(AMDGPUInfoPtr info)
+{
+	PixmapPtr staging = info->capture.pixmap;
+
+	if (!staging)
+		return;
+
+	amdgpu_bo_unmap(amdgpu_get_pixmap_bo(staging));
+	dixDestroyPixmap(staging, 0);
+	info->capture.pixmap = NULL;
+}
+
+/* Return the staging pixmap matching the current screen pixmap, (re)creating
+ * it if necessary
+ */
+static PixmapPtr
+amdgpu_glamor_capture_staging(ScreenPtr screen, PixmapPtr screen_pixmap)
+{
+	ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
+	AMDGPUInfoPtr info = AMDGPUPTR(scrn);
+	PixmapPtr staging = info->capture.pixmap;
+	int w = screen_pixmap->drawable.width;
+	int h = screen_pixmap->drawable.height;
+	struct amdgpu_pixmap *priv;
+	struct amdgpu_buffer *bo;
+	BoxRec box;
+	int stride;
+
+	if (staging && info->capture.damage &&
+	    staging->drawable.width == w &&
+	    staging->drawable.height == h &&
+	    staging->drawable.depth == screen_pixmap->drawable.depth)
+		return staging;
+
+	amdgpu_glamor_capture_free(info);
+
+	if (!info->capture.damage) {
+		info->capture.damage =
+			DamageCreate(NULL, amdgpu_glamor_capture_damage_destroy,
+				     DamageReportNone, TRUE, screen, info);
+		if (!info->capture.damage)
+			return NULL;
+
+		DamageRegister(&screen->root->drawable, info->capture.damage);
+	}
+
+	/* Allocate the BO explicitly: depending on the size and usage,
+	 * CreatePixmap may return a texture-only glamor pixmap
+	 */
+	bo = amdgpu_alloc_pixmap_bo(scrn, w, h, screen_pixmap->drawable.depth,
+				    AMDGPU_CREATE_PIXMAP_LINEAR |
+				    AMDGPU_CREATE_PIXMAP_GTT,
+				    screen_pixmap->drawable.bitsPerPixel,
+				    &stride);
+	if (!bo)
+		return NULL;
+
+	staging = screen->CreatePixmap(screen, 0, 0,
+				       screen_pixmap->drawable.depth, 0);
+	priv = calloc(1, sizeof(*priv));
+	if (!staging || !priv) {
+		free(priv);
+		if (staging)
+			dixDestroyPixmap(staging, 0);
+		amdgpu_bo_unref(&bo);
+		return NULL;
+	}
+
+	priv->bo = bo;
+	amdgpu_set_pixmap_private(staging, priv);
+	screen->ModifyPixmapHeader(staging, w, h, 0, 0, stride, NULL);
+
+	if ((bo->flags & AMDGPU_BO_FLAGS_GBM) ||
+	    !amdgpu_glamor_create_textured_pixmap(staging, bo) ||
+	    amdgpu_bo_map(scrn, bo) != 0) {
+		dixDestroyPixmap(staging, 0);
+		return NULL;
+	}
+
+	info->capture.pixmap = staging;
+
+	/* The new staging pixmap contents are undefined */
+	box.x1 = 0;
+	box.y1 = 0;
+	box.x2 = w;
+	box.y2 = h;
+	RegionReset(DamageRegion(info->capture.damage), &box);
+
+	return staging;
+}
+
+/* This also handles ShmGetImage, which passes the client's SHM segment as the
+ * destination. The segment can't be wrapped in a userptr BO and used as blit
+ * destination instead: the kernel refuses to export userptr BOs as dma-buf,
+ * so glamor can't create an EGL image for them.
+ */
+static void
+amdgpu_glamor_capture_get_image(DrawablePtr drawable, int x, int y, int w,
+				int h, unsigned int format,
+				unsigned long plane_mask, char *d)
+{
+	ScreenPtr screen = drawable->pScreen;
+	ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
+	AMDGPUInfoPtr info = AMDGPUPTR(scrn);
+	PixmapPtr screen_pixmap = screen->GetScreenPixmap(screen);
+	PixmapPtr staging = info->capture.pixmap;
+	struct amdgpu_buffer *bo;
+	RegionPtr copy_region;
+	RegionPtr damage_region;
+	BoxRec box;
+	bool busy;
+	GCPtr gc;
+
+	if (!screen->root || get_drawable_pixmap(drawable) != screen_pixmap ||
+	    (!staging && w * h < AMDGPU_CAPTURE_MIN_PIXELS))
+		goto fallback;
+
+	staging = amdgpu_glamor_capture_staging(screen, screen_pixmap);
+	if (!staging)
+		goto fallback;
+
+	bo = amdgpu_get_pixmap_bo(staging);
+
+	box.x1 = drawable->x + x;
+	box.y1 = drawable->y + y;
+	box.x2 = box.x1 + w;
+	box.y2 = box.y1 + h;
+
+	/* Bring the requested area of the staging pixmap up to date */
+	damage_region = DamageRegion(info->capture.damage);
+	copy_region = RegionCreate(&box, 1);
+	RegionIntersect(copy_region, copy_region, damage_region);
+
+	if (RegionNotEmpty(copy_region)) {
+		gc = GetScratchGC(staging->drawable.depth, screen);
+		if (!gc) {
+			RegionDestroy(copy_region);
+			goto fallback;
+		}
+
+		RegionSubtract(damage_region, damage_region, copy_region);
+		gc->funcs->ChangeClip(gc, CT_REGION, copy_region, 0);
+		ValidateGC(&staging->drawable, gc);
+		gc->ops->CopyArea(&screen_pixmap->drawable, &staging->drawable,
+				  gc, box.x1, box.y1, w, h, box.x1, box.y1);
+		FreeScratchGC(gc);
+
+		amdgpu_glamor_flush(scrn);
+		amdgpu_bo_wait_for_idle(bo->bo.amdgpu, UINT64_MAX, &busy);
+	} else {
+		RegionDestroy(copy_region);
+	}
+
+	staging->devPrivate.ptr = bo->cpu_ptr;
+	fbGetImage(&staging->drawable, box.x1, box.y1, w, h, format,
+		   plane_mask, d);
+	staging->devPrivate.ptr = NULL;
+	return;
+
+fallback:
+	info->capture.SavedGetImage(drawable, x, y, w, h, format, plane_mask,
+				    d);
+}
+
 Bool amdgpu_glamor_init(ScreenPtr screen)
 {
 	ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
@@ -443,6 +644,12 @@ Bool amdgpu_glamor_init(ScreenPtr screen)
 	screen->SetSharedPixmapBacking =
 	    amdgpu_glamor_set_shared_pixmap_backing;
 
+	/* With ShadowPrimary, the screen pixmap is in cacheable GTT already */
+	if (!info->shadow_primary) {
+		info->capture.SavedGetImage = screen->GetImage;
+		screen->GetImage = amdgpu_glamor_capture_get_image;
+	}
+
 	xf86DrvMsg(scrn->scrnIndex, X_INFO, "Use GLAMOR acceleration.\n");
 	return TRUE;
 }
@@ -451,6 +658,12 @@ void amdgpu_glamor_flush(ScrnInfoPtr pScrn)
 {
 	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
 
+	/* This flush takes care of any deferred flush as well */
+	if (info->flush_pending) {
+		info->flush_pending = 0;
+		info->flushes_avoided++;
+	}
+
 	if (info->use_glamor) {
 		glamor_block_handler(pScrn->pScreen);
 	}
@@ -458,12 +671,61 @@ void amdgpu_glamor_flush(ScrnInfoPtr pScrn)
 	info->gpu_flushed++;
 }
 
+/* Record that pending rendering needs to be flushed before the next flip or
+ * before the server goes to sleep. All such requests made during a dispatch
+ * cycle are merged into a single flush by amdgpu_glamor_flush_pending, or
+ * into the next amdgpu_glamor_flush call if it comes first.
+ */
+void amdgpu_glamor_flush_later(ScrnInfoPtr pScrn,
+			       enum amdgpu_flush_reason reason)
+{
+	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
+
+	info->flush_requests[reason]++;
+	if (info->flush_pending)
+		info->flushes_avoided++;
+	info->flush_pending |= 1 << reason;
+}
+
+/* Perform the flush deferred by amdgpu_glamor_flush_later, if any */
+void amdgpu_glamor_flush_pending(ScrnInfoPtr pScrn)
+{
+	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
+
+	if (!info->flush_pending)
+		return;
+
+	info->flush_pending = 0;
+	amdgpu_glamor_flush(pScrn);
+}
+
+void amdgpu_glamor_flush_stats_log(ScrnInfoPtr pScrn, int verb)
+{
+	static const char *reason_names[AMDGPU_FLUSH_NUM_REASONS] = {
+		[AMDGPU_FLUSH_PRIME] = "PRIME",
+	};
+	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
+	int i;
+
+	for (i = 0; i < AMDGPU_FLUSH_NUM_REASONS; i++) {
+		xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, verb,
+			       "%llu deferred flushes for %s updates\n",
+			       (unsigned long long)info->flush_requests[i],
+			       reason_names[i]);
+	}
+
+	xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, verb,
+		       "%llu flushes avoided by merging\n",
+		       (unsigned long long)info->flushes_avoided);
+}
+
 void amdgpu_glamor_finish(ScrnInfoPtr pScrn)
 {
 	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
 
 	if (info->use_glamor) {
 		glamor_finish(pScrn->pScreen);
+		info->flush_pending = 0;
 		info->gpu_flushed++;
 	}
 }
@@ -476,6 +738,15 @@ amdgpu_glamor_fini(ScreenPtr screen)
 	if (!info->use_glamor)
 		return;
 
+	if (info->capture.damage)
+		DamageDestroy(info->capture.damage);
+	amdgpu_glamor_capture_free(info);
+
+	if (info->capture.SavedGetImage) {
+		screen->GetImage = info->capture.SavedGetImage;
+		info->capture.SavedGetImage = NULL;
+	}
+
 	screen->CreatePixmap = info->glamor.SavedCreatePixmap;
 	screen->DestroyPixmap = info->glamor.SavedDestroyPixmap;
 	screen->SharePixmapBacking = info->glamor.SavedSharePixmapBacking;
@@ -64,6 +64,10 @@ Bool amdgpu_glamor_create_screen_resources(ScreenPtr screen);
 void amdgpu_glamor_free_screen(int scrnIndex, int flags);
 
 void amdgpu_glamor_flush(ScrnInfoPtr pScrn);
+void amdgpu_glamor_flush_later(ScrnInfoPtr pScrn,
+			       enum amdgpu_flush_reason reason);
+void amdgpu_glamor_flush_pending(ScrnInfoPtr pScrn);
+void amdgpu_glamor_flush_stats_log(ScrnInfoPtr pScrn, int verb);
 void amdgpu_glamor_finish(ScrnInfoPtr pScrn);
 
 Bool amdgpu_glamor_create_textured_pixmap(PixmapPtr pixmap,
@@ -31,9 +31,11 @@
 
 #include <fb.h>
 #include <fbpict.h>
+#include <mipict.h>
 
 #include "amdgpu_drv.h"
 #include "amdgpu_glamor.h"
+#include "amdgpu_parallel.h"
 #include "amdgpu_pixmap.h"
 
 /* Are there any outstanding GPU operations for this pixmap? */
@@ -738,6 +740,126 @@ amdgpu_glamor_get_spans(DrawablePtr pDrawable, int wMax, DDXPointPtr ppt,
  * Picture screen rendering wrappers
  */
 
+/*
+ * Parallel CPU compositing
+ *
+ * Large fallback composite operations are split into horizontal bands of the
+ * destination, which are rendered by pixman concurrently. Each band gets its
+ * own set of pixman images, so the threads don't share any pixman state.
+ */
+
+/* Minimum number of pixels for splitting up a composite operation */
+#define AMDGPU_PARALLEL_MIN_PIXELS (256 * 256)
+/* Minimum height of each band */
+#define AMDGPU_PARALLEL_MIN_ROWS 16
+
+struct amdgpu_composite_band {
+	pixman_image_t *src, *mask, *dst;
+	int src_x, src_y, mask_x, mask_y, dst_x, dst_y;
+	int width, height;
+	pixman_op_t op;
+};
+
+static void
+amdgpu_glamor_composite_band(void *data, int index)
+{
+	struct amdgpu_composite_band *band =
+		(struct amdgpu_composite_band *)data + index;
+
+	pixman_image_composite32(band->op, band->src, band->mask, band->dst,
+				 band->src_x, band->src_y,
+				 band->mask_x, band->mask_y,
+				 band->dst_x, band->dst_y,
+				 band->width, band->height);
+}
+
+/* Whether the picture, or its alpha map, reads from the given pixmap */
+static Bool
+amdgpu_glamor_picture_uses_pixmap(PicturePtr pict, PixmapPtr pixmap)
+{
+	if (!pict)
+		return FALSE;
+
+	if (pict->pDrawable && get_drawable_pixmap(pict->pDrawable) == pixmap)
+		return TRUE;
+
+	return pict->alphaMap && pict->alphaMap->pDrawable &&
+		get_drawable_pixmap(pict->alphaMap->pDrawable) == pixmap;
+}
+
+static void
+amdgpu_glamor_fb_composite(CARD8 op, PicturePtr pSrc, PicturePtr pMask,
+			   PicturePtr pDst, INT16 xSrc, INT16 ySrc,
+			   INT16 xMask, INT16 yMask, INT16 xDst, INT16 yDst,
+			   CARD16 width, CARD16 height)
+{
+	struct amdgpu_composite_band bands[AMDGPU_PARALLEL_MAX_THREADS];
+	PixmapPtr dst_pixmap = get_drawable_pixmap(pDst->pDrawable);
+	Bool images_ok = TRUE;
+	int num_bands = min(amdgpu_parallel_threads(),
+			    height / AMDGPU_PARALLEL_MIN_ROWS);
+	int src_xoff, src_yoff, mask_xoff, mask_yoff, dst_xoff, dst_yoff;
+	int i, y = 0;
+
+	/* If the source or mask is the destination, one band could read rows
+	 * while another band is writing them
+	 */
+	if ((int)width * height < AMDGPU_PARALLEL_MIN_PIXELS ||
+	    num_bands < 2 ||
+	    amdgpu_glamor_picture_uses_pixmap(pSrc, dst_pixmap) ||
+	    amdgpu_glamor_picture_uses_pixmap(pMask, dst_pixmap)) {
+		fbComposite(op, pSrc, pMask, pDst, xSrc, ySrc, xMask, yMask,
+			    xDst, yDst, width, height);
+		return;
+	}
+
+	num_bands = min(num_bands, AMDGPU_PARALLEL_MAX_THREADS);
+
+	miCompositeSourceValidate(pSrc);
+	if (pMask)
+		miCompositeSourceValidate(pMask);
+
+	for (i = 0; i < num_bands; i++) {
+		struct amdgpu_composite_band *band = &bands[i];
+		int y2 = height * (i + 1) / num_bands;
+
+		band->src = image_from_pict(pSrc, FALSE, &src_xoff, &src_yoff);
+		band->mask = pMask ?
+			image_from_pict(pMask, FALSE, &mask_xoff, &mask_yoff) :
+			NULL;
+		band->dst = image_from_pict(pDst, TRUE, &dst_xoff, &dst_yoff);
+
+		if (!band->src || !band->dst || (pMask && !band->mask)) {
+			images_ok = FALSE;
+			num_bands = i + 1;
+			break;
+		}
+
+		band->op = op;
+		band->src_x = xSrc + src_xoff;
+		band->src_y = ySrc + src_yoff + y;
+		band->mask_x = xMask + mask_xoff;
+		band->mask_y = yMask + mask_yoff + y;
+		band->dst_x = xDst + dst_xoff;
+		band->dst_y = yDst + dst_yoff + y;
+		band->width = width;
+		band->height = y2 - y;
+		y = y2;
+	}
+
+	if (images_ok) {
+		amdgpu_parallel_run(amdgpu_glamor_composite_band, bands,
+				    num_bands);
+	}
+
+	for (i = 0; i < num_bands; i++) {
+		free_pixman_pict(pSrc, bands[i].src);
+		if (pMask)
+			free_pixman_pict(pMask, bands[i].mask);
+		free_pixman_pict(pDst, bands[i].dst);
+	}
+}
+
 static void
 amdgpu_glamor_composite(CARD8 op,
 			PicturePtr pSrc,
@@ -797,11 +919,11 @@ fallback:
 		if (amdgpu_glamor_picture_prepare_access_cpu_ro(scrn, pSrc)) {
 			if (!pMask ||
 			    amdgpu_glamor_picture_prepare_access_cpu_ro(scrn, pMask)) {
-				fbComposite(op, pSrc, pMask, pDst,
-					    xSrc, ySrc,
-					    xMask, yMask,
-					    xDst, yDst,
-					    width, height);
+				amdgpu_glamor_fb_composite(op, pSrc, pMask, pDst,
+							   xSrc, ySrc,
+							   xMask, yMask,
+							   xDst, yDst,
+							   width, height);
 				if (pMask)
 					amdgpu_glamor_picture_finish_access_cpu(pMask);
 			}
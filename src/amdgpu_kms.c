@@ -35,9 +35,12 @@
 /* Driver data structures */
 #include "amdgpu_drv.h"
 #include "amdgpu_bo_helper.h"
+#include "amdgpu_copy.h"
 #include "amdgpu_drm_queue.h"
 #include "amdgpu_glamor.h"
+#include "amdgpu_parallel.h"
 #include "amdgpu_probe.h"
+#include "amdgpu_timing.h"
 #include "micmap.h"
 #include "mipointrst.h"
 
@@ -81,6 +84,8 @@ const OptionInfoRec AMDGPUOptions_KMS[] = {
 	{OPTION_DELETE_DP12, "DeleteUnusedDP12Displays", OPTV_BOOLEAN, .value = {0}, FALSE},
 	{OPTION_VARIABLE_REFRESH, "VariableRefresh", OPTV_BOOLEAN, .value = {0}, FALSE },
 	{OPTION_ASYNC_FLIP_SECONDARIES, "AsyncFlipSecondaries", OPTV_BOOLEAN, .value = {0}, FALSE},
+	{OPTION_VRAM_PRESSURE_THRESHOLD, "VRAMPressureThreshold", OPTV_INTEGER, .value = {0}, FALSE},
+	{OPTION_CURSOR_CACHE_SIZE, "CursorCacheSize", OPTV_INTEGER, .value = {0}, FALSE},
 	{-1, NULL, OPTV_NONE, .value = {0}, FALSE}
 };
 
@@ -254,6 +259,9 @@ static void AMDGPUFreeRec(ScrnInfoPtr pScrn)
 	if (info) {
 		pAMDGPUEnt->scrn[info->instance_id] = NULL;
 		pAMDGPUEnt->num_scrns--;
+		free(info->drmmode.scanout_modifiers);
+		drmmode_free_formats(info->drmmode.formats,
+				     info->drmmode.num_formats);
 		free(pScrn->driverPrivate);
 		pScrn->driverPrivate = NULL;
 	}
@@ -268,6 +276,7 @@ static void AMDGPUFreeRec(ScrnInfoPtr pScrn)
 			amdgpu_unwrap_property_requests(pScrn);
 			amdgpu_device_deinitialize(pAMDGPUEnt->pDev);
 			amdgpu_kernel_close_fd(pAMDGPUEnt);
+			drmmode_mode_cache_fini(pAMDGPUEnt);
 			free(pAMDGPUEnt->busid);
 			free(pPriv->ptr);
 			pPriv->ptr = NULL;
@@ -296,10 +305,90 @@ static void *amdgpuShadowWindow(ScreenPtr screen, CARD32 row, CARD32 offset,
 	return ((uint8_t *) info->front_buffer->cpu_ptr + row * stride + offset);
 }
 
+/* Minimum number of damaged pixels for spreading the update across threads */
+#define AMDGPU_SHADOW_PARALLEL_PIXELS (512 * 512)
+
+struct amdgpu_shadow_update {
+	BoxPtr boxes;
+	int nboxes;
+	int y1, y2;		/* Damage extents */
+	int num_bands;
+	int cpp;
+	uint8_t *src;
+	int src_stride;
+	uint8_t *dst;
+	int dst_stride;
+};
+
+/* Copy the damaged rows in band index from the shadow to the front buffer */
+static void
+amdgpu_shadow_update_band(void *data, int index)
+{
+	struct amdgpu_shadow_update *update = data;
+	int height = update->y2 - update->y1;
+	int band_y1 = update->y1 + height * index / update->num_bands;
+	int band_y2 = update->y1 + height * (index + 1) / update->num_bands;
+	int i, y;
+
+	for (i = 0; i < update->nboxes; i++) {
+		BoxPtr box = &update->boxes[i];
+		int y1 = max(box->y1, band_y1);
+		int y2 = min(box->y2, band_y2);
+		size_t offset = box->x1 * update->cpp;
+		size_t size = (box->x2 - box->x1) * update->cpp;
+
+		for (y = y1; y < y2; y++) {
+			amdgpu_copy_to_wc(update->dst + y * update->dst_stride +
+					  offset,
+					  update->src + y * update->src_stride +
+					  offset, size);
+		}
+	}
+
+	amdgpu_copy_to_wc_finish();
+}
+
+/* Like shadowUpdatePacked, but copies the damaged boxes directly using
+ * streaming stores, and splits large updates across worker threads
+ */
 static void
 amdgpuUpdatePacked(ScreenPtr pScreen, shadowBufPtr pBuf)
 {
-	shadowUpdatePacked(pScreen, pBuf);
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
+	RegionPtr damage = DamageRegion(pBuf->pDamage);
+	PixmapPtr shadow = pBuf->pPixmap;
+	struct amdgpu_shadow_update update;
+	uint64_t pixels = 0;
+	int i;
+
+	if (!shadow->devPrivate.ptr || !info->front_buffer->cpu_ptr) {
+		shadowUpdatePacked(pScreen, pBuf);
+		return;
+	}
+
+	update.boxes = RegionRects(damage);
+	update.nboxes = RegionNumRects(damage);
+	update.y1 = RegionExtents(damage)->y1;
+	update.y2 = RegionExtents(damage)->y2;
+	update.cpp = pScrn->bitsPerPixel / 8;
+	update.src = shadow->devPrivate.ptr;
+	update.src_stride = shadow->devKind;
+	update.dst = info->front_buffer->cpu_ptr;
+	update.dst_stride = (pScrn->displayWidth * pScrn->bitsPerPixel) / 8;
+
+	for (i = 0; i < update.nboxes; i++) {
+		pixels += (uint64_t)(update.boxes[i].x2 - update.boxes[i].x1) *
+			(update.boxes[i].y2 - update.boxes[i].y1);
+	}
+
+	update.num_bands = 1;
+	if (pixels >= AMDGPU_SHADOW_PARALLEL_PIXELS)
+		update.num_bands = min(amdgpu_parallel_threads(),
+				       update.y2 - update.y1);
+
+	amdgpu_parallel_run(amdgpu_shadow_update_band, &update,
+			    update.num_bands);
 }
 
 static Bool
@@ -365,6 +454,7 @@ static Bool AMDGPUCreateScreenResources_KMS(ScreenPtr pScreen)
 	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
 	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
 	PixmapPtr pixmap;
+	uint64_t start;
 
 	pScreen->CreateScreenResources = info->CreateScreenResources;
 	if (!(*pScreen->CreateScreenResources) (pScreen))
@@ -386,12 +476,23 @@ static Bool AMDGPUCreateScreenResources_KMS(ScreenPtr pScreen)
 		drmmode_uevent_init(pScrn, &info->drmmode);
 	}
 
-	if (!drmmode_set_desired_modes(pScrn, &info->drmmode, pScreen->isGPU))
+	/* Only GPU screens set the hardware modes here, see
+	 * AMDGPUWindowExposures_oneshot for the other screens
+	 */
+	if (pScreen->isGPU) {
+		start = amdgpu_timing_begin();
+		if (!drmmode_set_desired_modes(pScrn, &info->drmmode, TRUE))
+			return FALSE;
+		amdgpu_timing_end(AMDGPUEntPriv(pScrn), AMDGPU_PHASE_SET_MODES,
+				  start);
+	} else if (!drmmode_set_desired_modes(pScrn, &info->drmmode, FALSE)) {
 		return FALSE;
+	}
 
 	if (info->shadow_fb) {
 		pixmap = pScreen->GetScreenPixmap(pScreen);
 
+		amdgpu_copy_init();
 		if (!shadowAdd(pScreen, pixmap, amdgpuUpdatePacked,
 			       amdgpuShadowWindow, 0, NULL))
 			return FALSE;
@@ -435,6 +536,9 @@ static Bool AMDGPUCreateScreenResources_KMS(ScreenPtr pScreen)
 				   sizeof(struct amdgpu_window_priv)))
 		return FALSE;
 
+	if (pScreen->isGPU)
+		amdgpu_timing_log(pScrn);
+
 	return TRUE;
 }
 
@@ -618,9 +722,11 @@ redisplay_dirty(PixmapDirtyUpdatePtr dirty, RegionPtr region)
 
 	PixmapSyncDirtyHelper(dirty);
 
-	amdgpu_glamor_flush(src_scrn);
-	if (dirty->secondary_dst->primary_pixmap)
+	amdgpu_glamor_flush_later(src_scrn, AMDGPU_FLUSH_PRIME);
+	if (dirty->secondary_dst->primary_pixmap) {
+		amdgpu_glamor_flush_pending(src_scrn);
 		DamageRegionProcessPending(&dirty->secondary_dst->drawable);
+	}
 
 out:
 	DamageEmpty(dirty->damage);
@@ -649,6 +755,9 @@ amdgpu_sync_shared_pixmap(PixmapDirtyUpdatePtr dirty)
 		redisplay_dirty(ent, region);
 		RegionDestroy(region);
 	}
+
+	/* The caller is about to consume the updated contents */
+	amdgpu_glamor_flush_pending(xf86ScreenToScrn(primary_screen));
 }
 
 static Bool
@@ -718,7 +827,7 @@ amdgpu_prime_scanout_do_update(xf86CrtcPtr crtc, unsigned scanout_id)
 			if (drmmode_crtc->tear_free) {
 				RegionTranslate(region, crtc->x, crtc->y);
 				amdgpu_sync_scanout_pixmaps(crtc, region, scanout_id);
-				amdgpu_glamor_flush(scrn);
+				amdgpu_glamor_flush_later(scrn, AMDGPU_FLUSH_PRIME);
 				RegionCopy(&drmmode_crtc->scanout_last_region, region);
 				RegionTranslate(region, -crtc->x, -crtc->y);
 				dirty->secondary_dst = drmmode_crtc->scanout[scanout_id];
@@ -834,6 +943,8 @@ amdgpu_prime_scanout_flip(PixmapDirtyUpdatePtr ent)
 	if (!amdgpu_prime_scanout_do_update(crtc, scanout_id))
 		return;
 
+	amdgpu_glamor_flush_pending(scrn);
+
 	fb = amdgpu_pixmap_get_fb(drmmode_crtc->scanout[scanout_id]);
 	if (!fb) {
 		xf86DrvMsg(scrn->scrnIndex, X_WARNING,
@@ -1036,6 +1147,10 @@ amdgpu_scanout_update_handler(xf86CrtcPtr crtc, uint32_t frame, uint64_t usec,
 		if (amdgpu_scanout_do_update(crtc, drmmode_crtc->scanout_id,
 					     screen->GetWindowPixmap(screen->root),
 					     region->extents)) {
+			/* The update was timed for this vblank period, so it
+			 * has to reach the GPU now rather than after the next
+			 * dispatch cycle
+			 */
 			amdgpu_glamor_flush(crtc->scrn);
 			RegionEmpty(region);
 		}
@@ -1207,7 +1322,7 @@ static void AMDGPUBlockHandler_KMS(ScreenPtr pScreen, void* pTimeout)
 	pScreen->BlockHandler = AMDGPUBlockHandler_KMS;
 
 	if (!xf86ScreenToScrn(amdgpu_primary_screen(pScreen))->vtSema)
-		return;
+		goto flush;
 
 	if (!pScreen->isGPU)
 	{
@@ -1226,6 +1341,10 @@ static void AMDGPUBlockHandler_KMS(ScreenPtr pScreen, void* pTimeout)
 	}
 
 	amdgpu_dirty_update(pScrn);
+
+flush:
+	/* Last chance to flush before the server goes to sleep */
+	amdgpu_glamor_flush_pending(pScrn);
 }
 
 /* This is called by AMDGPUPreInit to set up the default visual */
@@ -1469,6 +1588,7 @@ void AMDGPUWindowExposures_oneshot(WindowPtr pWin, RegionPtr pRegion)
 	ScreenPtr pScreen = pWin->drawable.pScreen;
 	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
 	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
+	uint64_t start;
 
 	if (pWin != pScreen->root)
 		ErrorF("%s called for non-root window %p\n", __func__, pWin);
@@ -1477,7 +1597,11 @@ void AMDGPUWindowExposures_oneshot(WindowPtr pWin, RegionPtr pRegion)
 	pScreen->WindowExposures(pWin, pRegion);
 
 	amdgpu_glamor_finish(pScrn);
+
+	start = amdgpu_timing_begin();
 	drmmode_set_desired_modes(pScrn, &info->drmmode, TRUE);
+	amdgpu_timing_end(AMDGPUEntPriv(pScrn), AMDGPU_PHASE_SET_MODES, start);
+	amdgpu_timing_log(pScrn);
 }
 
 Bool AMDGPUPreInit_KMS(ScrnInfoPtr pScrn, int flags)
@@ -1490,10 +1614,13 @@ Bool AMDGPUPreInit_KMS(ScrnInfoPtr pScrn, int flags)
 	int cpp;
 	uint64_t heap_size = 0;
 	uint64_t max_allocation = 0;
+	uint64_t preinit_start, start;
 
 	if (flags & PROBE_DETECT)
 		return TRUE;
 
+	preinit_start = amdgpu_timing_begin();
+
 	xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, AMDGPU_LOGLEVEL_DEBUG,
 		       "AMDGPUPreInit_KMS\n");
 	if (pScrn->numEntities != 1)
@@ -1557,8 +1684,10 @@ Bool AMDGPUPreInit_KMS(ScrnInfoPtr pScrn, int flags)
 	if (!xf86LoadSubModule(pScrn, "fb"))
 		return FALSE;
 
+	start = amdgpu_timing_begin();
 	if (!AMDGPUPreInitAccel_KMS(pScrn))
 		return FALSE;
+	amdgpu_timing_end(pAMDGPUEnt, AMDGPU_PHASE_ACCEL_PREINIT, start);
 
 	amdgpu_drm_queue_init(pScrn);
 
@@ -1628,12 +1757,14 @@ Bool AMDGPUPreInit_KMS(ScrnInfoPtr pScrn, int flags)
 		info->drmmode.delete_dp_12_displays = TRUE;
 	}
 
+	start = amdgpu_timing_begin();
 	if (drmmode_pre_init(pScrn, &info->drmmode, pScrn->bitsPerPixel / 8) ==
 	    FALSE) {
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
 			   "Kernel modesetting setup failed\n");
 		return FALSE;
 	}
+	amdgpu_timing_end(pAMDGPUEnt, AMDGPU_PHASE_DRMMODE_PREINIT, start);
 
 	AMDGPUSetupCapabilities(pScrn);
 
@@ -1657,6 +1788,42 @@ Bool AMDGPUPreInit_KMS(ScrnInfoPtr pScrn, int flags)
 		   (unsigned long long)heap_size,
 		   (unsigned long long)max_allocation);
 
+	info->vram_pressure_threshold = 90;
+	from = xf86GetOptValInteger(info->Options, OPTION_VRAM_PRESSURE_THRESHOLD,
+				    &info->vram_pressure_threshold) ?
+		X_CONFIG : X_DEFAULT;
+	if (info->vram_pressure_threshold < 0 ||
+	    info->vram_pressure_threshold > 100) {
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			   "Invalid VRAMPressureThreshold %d, using default\n",
+			   info->vram_pressure_threshold);
+		info->vram_pressure_threshold = 90;
+		from = X_DEFAULT;
+	}
+	if (info->vram_pressure_threshold)
+		xf86DrvMsg(pScrn->scrnIndex, from,
+			   "Allocating pixmaps in GTT above %d%% VRAM usage\n",
+			   info->vram_pressure_threshold);
+	else
+		xf86DrvMsg(pScrn->scrnIndex, from,
+			   "VRAM pressure tracking disabled\n");
+
+	info->cursor_cache_size = DRMMODE_CURSOR_CACHE_DEFAULT;
+	from = xf86GetOptValInteger(info->Options, OPTION_CURSOR_CACHE_SIZE,
+				    &info->cursor_cache_size) ?
+		X_CONFIG : X_DEFAULT;
+	if (info->cursor_cache_size < 2 ||
+	    info->cursor_cache_size > DRMMODE_CURSOR_CACHE_MAX) {
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+			   "Invalid CursorCacheSize %d, using default\n",
+			   info->cursor_cache_size);
+		info->cursor_cache_size = DRMMODE_CURSOR_CACHE_DEFAULT;
+		from = X_DEFAULT;
+	}
+	xf86DrvMsg(pScrn->scrnIndex, from,
+		   "Caching up to %d cursor images per CRTC\n",
+		   info->cursor_cache_size);
+
 	cpp = pScrn->bitsPerPixel / 8;
 	pScrn->displayWidth =
 	    AMDGPU_ALIGN(pScrn->virtualX, drmmode_get_pitch_align(pScrn, cpp));
@@ -1681,6 +1848,8 @@ Bool AMDGPUPreInit_KMS(ScrnInfoPtr pScrn, int flags)
 		return FALSE;
 	}
 
+	amdgpu_timing_end(pAMDGPUEnt, AMDGPU_PHASE_PREINIT, preinit_start);
+
 	return TRUE;
 }
 
@@ -1874,6 +2043,8 @@ static Bool AMDGPUCloseScreen_KMS(ScreenPtr pScreen)
 
 	amdgpu_sync_close(pScreen);
 	amdgpu_drop_drm_master(pScrn);
+	amdgpu_mem_stats_log(pScrn, AMDGPU_LOGLEVEL_DEBUG);
+	amdgpu_glamor_flush_stats_log(pScrn, AMDGPU_LOGLEVEL_DEBUG);
 
 	drmmode_fini(pScrn, &info->drmmode);
 	if (info->dri2.enabled) {
@@ -1908,14 +2079,20 @@ Bool AMDGPUScreenInit_KMS(ScreenPtr pScreen, int argc, char **argv)
 {
 	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
 	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
+	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(pScrn);
 	int subPixelOrder = SubPixelUnknown;
 	MessageType from;
 	Bool value;
 	int driLevel;
 	const char *s;
 	void *front_ptr;
+	uint64_t screeninit_start, start;
+
+	screeninit_start = amdgpu_timing_begin();
 
 	pScrn->fbOffset = 0;
+	xorg_list_init(&info->fb_pixmaps);
+	xorg_list_init(&info->export_pixmaps);
 
 	miClearVisualTypes();
 	if (!miSetVisualTypes(pScrn->depth,
@@ -1928,8 +2105,11 @@ Bool AMDGPUScreenInit_KMS(ScreenPtr pScreen, int argc, char **argv)
 		return FALSE;
 
 	info->directRenderingEnabled = FALSE;
-	if (info->shadow_fb == FALSE)
+	if (info->shadow_fb == FALSE) {
+		start = amdgpu_timing_begin();
 		info->directRenderingEnabled = amdgpu_dri2_screen_init(pScreen);
+		amdgpu_timing_end(pAMDGPUEnt, AMDGPU_PHASE_DRI2, start);
+	}
 
 	if (!amdgpu_setup_kernel_mem(pScreen)) {
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
@@ -2011,9 +2191,11 @@ Bool AMDGPUScreenInit_KMS(ScreenPtr pScreen, int argc, char **argv)
 	}
 
 	if (value) {
+		start = amdgpu_timing_begin();
 		value = amdgpu_sync_init(pScreen) &&
 			amdgpu_present_screen_init(pScreen) &&
 			amdgpu_dri3_screen_init(pScreen);
+		amdgpu_timing_end(pAMDGPUEnt, AMDGPU_PHASE_DRI3, start);
 
 		if (!value)
 			from = X_WARNING;
@@ -2035,7 +2217,10 @@ Bool AMDGPUScreenInit_KMS(ScreenPtr pScreen, int argc, char **argv)
 	if (info->use_glamor && info->directRenderingEnabled) {
 		xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, AMDGPU_LOGLEVEL_DEBUG,
 			       "Initializing Acceleration\n");
-		if (amdgpu_glamor_init(pScreen)) {
+		start = amdgpu_timing_begin();
+		value = amdgpu_glamor_init(pScreen);
+		amdgpu_timing_end(pAMDGPUEnt, AMDGPU_PHASE_GLAMOR, start);
+		if (value) {
 			xf86DrvMsg(pScrn->scrnIndex, X_INFO,
 				   "Acceleration enabled\n");
 #ifdef GBM_BO_WITH_MODIFIERS
@@ -2076,7 +2261,9 @@ Bool AMDGPUScreenInit_KMS(ScreenPtr pScreen, int argc, char **argv)
 		/* Init Xv */
 		xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, AMDGPU_LOGLEVEL_DEBUG,
 			       "Initializing Xv\n");
+		start = amdgpu_timing_begin();
 		AMDGPUInitVideo(pScreen);
+		amdgpu_timing_end(pAMDGPUEnt, AMDGPU_PHASE_VIDEO, start);
 	}
 
 	if (info->shadow_fb == TRUE) {
@@ -2144,6 +2331,8 @@ Bool AMDGPUScreenInit_KMS(ScreenPtr pScreen, int argc, char **argv)
 	xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, AMDGPU_LOGLEVEL_DEBUG,
 		       "AMDGPUScreenInit finished\n");
 
+	amdgpu_timing_end(pAMDGPUEnt, AMDGPU_PHASE_SCREENINIT, screeninit_start);
+
 	return TRUE;
 }
 
@@ -2203,15 +2392,6 @@ pixmap_unref_fb(PixmapPtr pixmap)
 		drmmode_fb_reference(pAMDGPUEnt->fd, fb_ptr, NULL);
 }
 
-static void
-client_pixmap_unref_fb(void *value, XID id, void *pScreen)
-{
-	PixmapPtr pixmap = value;
-
-	if (pixmap->drawable.pScreen == pScreen)
-		pixmap_unref_fb(pixmap);
-}
-
 void AMDGPULeaveVT_KMS(ScrnInfoPtr pScrn)
 {
 	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
@@ -2223,6 +2403,7 @@ void AMDGPULeaveVT_KMS(ScrnInfoPtr pScrn)
 	if (!info->shadow_fb) {
 		AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(pScrn);
 		xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+		struct amdgpu_pixmap *priv, *tmp;
 		xf86CrtcPtr crtc;
 		drmmode_crtc_private_ptr drmmode_crtc;
 		unsigned w = 0, h = 0;
@@ -2274,14 +2455,10 @@ void AMDGPULeaveVT_KMS(ScrnInfoPtr pScrn)
 									     &drmmode_crtc->fb, NULL);
 						}
 
-						if (pScrn->is_gpu) {
-							if (drmmode_crtc->scanout[0])
-								pixmap_unref_fb(drmmode_crtc->scanout[0]);
-							if (drmmode_crtc->scanout[1])
-								pixmap_unref_fb(drmmode_crtc->scanout[1]);
-						} else {
-							drmmode_crtc_scanout_free(crtc);
-						}
+						/* Keep the scanout pixmaps for EnterVT, their FBs
+						 * are released below
+						 */
+						drmmode_crtc_scanout_suspend(crtc);
 					}
 				}
 				dixDestroyPixmap(black_scanout, 0);
@@ -2293,14 +2470,12 @@ void AMDGPULeaveVT_KMS(ScrnInfoPtr pScrn)
 		/* Unreference FBs of all pixmaps. After this, the only FB remaining
 		 * should be the all-black one being scanned out by active CRTCs
 		 */
-		for (i = 0; i < currentMaxClients; i++) {
-			if (i > 0 &&
-			    (!clients[i] || clients[i]->clientState != ClientStateRunning))
-				continue;
-
-			FindClientResourcesByType(clients[i], RT_PIXMAP,
-						  client_pixmap_unref_fb, pScreen);
+		xorg_list_for_each_entry_safe(priv, tmp, &info->fb_pixmaps,
+					      fb_list) {
+			drmmode_fb_reference(pAMDGPUEnt->fd, &priv->fb, NULL);
+			amdgpu_pixmap_untrack_fb(priv);
 		}
+		amdgpu_import_cache_release_fbs(pAMDGPUEnt->fd);
 
 		pixmap_unref_fb(pScreen->GetScreenPixmap(pScreen));
 	} else {
@@ -2338,35 +2513,24 @@ void AMDGPUAdjustFrame_KMS(ScrnInfoPtr pScrn, int x, int y)
 static Bool amdgpu_setup_kernel_mem(ScreenPtr pScreen)
 {
 	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
-	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(pScrn);
 	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
 	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
 	int cpp = info->pixel_bytes;
-	int cursor_size;
 	int c, i;
 
-	cursor_size = info->cursor_w * info->cursor_h * 4;
-	cursor_size = AMDGPU_ALIGN(cursor_size, AMDGPU_GPU_PAGE_SIZE);
+	/* Two cursor BOs per CRTC are needed to switch between cursor images
+	 * without tearing, the remaining ones of the cache are allocated on
+	 * demand by drmmode_load_cursor_argb
+	 */
 	for (c = 0; c < xf86_config->num_crtc; c++) {
 		drmmode_crtc_private_ptr drmmode_crtc = xf86_config->crtc[c]->driver_private;
 
 		for (i = 0; i < 2; i++) {
-			if (!drmmode_crtc->cursor_buffer[i]) {
-				drmmode_crtc->cursor_buffer[i] =
-					amdgpu_bo_open(pAMDGPUEnt->pDev,
-						       cursor_size, 0,
-						       AMDGPU_GEM_DOMAIN_VRAM);
-
-				if (!(drmmode_crtc->cursor_buffer[i])) {
-					ErrorF("Failed to allocate cursor buffer memory\n");
-					if (i > 0)
-						amdgpu_bo_unref(&drmmode_crtc->cursor_buffer[0]);
-					return FALSE;
-				}
-
-				if (amdgpu_bo_cpu_map(drmmode_crtc->cursor_buffer[i]->bo.amdgpu,
-						      &drmmode_crtc->cursor_buffer[i]->cpu_ptr))
-					ErrorF("Failed to map cursor buffer memory\n");
+			if (!drmmode_crtc_cursor_buffer_alloc(xf86_config->crtc[c], i)) {
+				ErrorF("Failed to allocate cursor buffer memory\n");
+				if (i > 0)
+					amdgpu_bo_unref(&drmmode_crtc->cursor_buffer[0].bo);
+				return FALSE;
 			}
 		}
 	}
@@ -0,0 +1,153 @@
+/*
+ * Copyright © 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "amdgpu_parallel.h"
+
+/*
+ * A small pool of worker threads for splitting up CPU rendering fallbacks.
+ * The pool is shared by all screens and created on first use. Only the
+ * main thread ever submits work, and it waits for the work to complete, so
+ * the workers never run concurrently with the rest of the server.
+ *
+ * Only plain pthreads are used, test/parallel_test.c builds this without
+ * the server.
+ */
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	void (*func)(void *data, int index);
+	void *data;
+	int next;
+	int count;
+	int remaining;
+	/* Including the main thread, 0 if not initialized yet */
+	int num_threads;
+} amdgpu_parallel = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work_cond = PTHREAD_COND_INITIALIZER,
+	.done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+/* Run jobs until there are none left. Called with the lock held. */
+static void
+amdgpu_parallel_do_work(void)
+{
+	while (amdgpu_parallel.next < amdgpu_parallel.count) {
+		int index = amdgpu_parallel.next++;
+
+		pthread_mutex_unlock(&amdgpu_parallel.lock);
+		amdgpu_parallel.func(amdgpu_parallel.data, index);
+		pthread_mutex_lock(&amdgpu_parallel.lock);
+
+		if (--amdgpu_parallel.remaining == 0)
+			pthread_cond_signal(&amdgpu_parallel.done_cond);
+	}
+}
+
+static void *
+amdgpu_parallel_worker(void *arg)
+{
+	pthread_mutex_lock(&amdgpu_parallel.lock);
+
+	for (;;) {
+		while (amdgpu_parallel.next >= amdgpu_parallel.count)
+			pthread_cond_wait(&amdgpu_parallel.work_cond,
+					  &amdgpu_parallel.lock);
+
+		amdgpu_parallel_do_work();
+	}
+
+	return NULL;
+}
+
+int
+amdgpu_parallel_threads(void)
+{
+	sigset_t set, old_set;
+	pthread_t thread;
+	long num_cpus;
+	int i;
+
+	if (amdgpu_parallel.num_threads)
+		return amdgpu_parallel.num_threads;
+
+	amdgpu_parallel.num_threads = 1;
+
+	num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_cpus > AMDGPU_PARALLEL_MAX_THREADS)
+		num_cpus = AMDGPU_PARALLEL_MAX_THREADS;
+
+	/* The workers mustn't handle any signals meant for the server */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &old_set);
+
+	for (i = 1; i < num_cpus; i++) {
+		if (pthread_create(&thread, NULL, amdgpu_parallel_worker,
+				   NULL) != 0)
+			break;
+
+		pthread_detach(thread);
+		amdgpu_parallel.num_threads++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+
+	return amdgpu_parallel.num_threads;
+}
+
+void
+amdgpu_parallel_run(void (*func)(void *data, int index), void *data,
+		    int count)
+{
+	int i;
+
+	if (amdgpu_parallel_threads() < 2 || count < 2) {
+		for (i = 0; i < count; i++)
+			func(data, i);
+		return;
+	}
+
+	pthread_mutex_lock(&amdgpu_parallel.lock);
+
+	amdgpu_parallel.func = func;
+	amdgpu_parallel.data = data;
+	amdgpu_parallel.next = 0;
+	amdgpu_parallel.count = count;
+	amdgpu_parallel.remaining = count;
+	pthread_cond_broadcast(&amdgpu_parallel.work_cond);
+
+	amdgpu_parallel_do_work();
+
+	while (amdgpu_parallel.remaining)
+		pthread_cond_wait(&amdgpu_parallel.done_cond,
+				  &amdgpu_parallel.lock);
+
+	amdgpu_parallel.count = 0;
+	pthread_mutex_unlock(&amdgpu_parallel.lock);
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright © 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef AMDGPU_PARALLEL_H
+#define AMDGPU_PARALLEL_H
+
+/* Upper bound for amdgpu_parallel_threads() */
+#define AMDGPU_PARALLEL_MAX_THREADS 8
+
+/* Number of threads amdgpu_parallel_run can spread work across, including
+ * the calling thread
+ */
+int amdgpu_parallel_threads(void);
+
+/* Call func(data, i) for each i in [0, count) on the worker threads and the
+ * calling thread, and return once all calls have completed
+ */
+void amdgpu_parallel_run(void (*func)(void *data, int index), void *data,
+			 int count);
+
+#endif /* AMDGPU_PARALLEL_H */
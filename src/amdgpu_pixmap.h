@@ -37,10 +37,21 @@ struct amdgpu_pixmap {
 	struct amdgpu_buffer *bo;
 	struct drmmode_fb *fb;
 	Bool fb_failed;
+	struct xorg_list fb_list;	/* in AMDGPUInfoRec::fb_pixmaps if linked */
 
 	/* GEM handle for pixmaps shared via DRI2/3 */
 	Bool handle_valid;
 	uint32_t handle;
+
+	/* Cached DRI3 export of the pixmap storage, handed out with dup() */
+	struct xorg_list export_list;	/* in AMDGPUInfoRec::export_pixmaps if linked */
+	struct amdgpu_buffer *export_bo;	/* priv->bo when the export was cached */
+	int num_export_fds;
+	int export_fds[4];
+	uint32_t export_strides[4];
+	uint32_t export_offsets[4];
+	uint64_t export_modifier;
+	uint32_t export_size;
 };
 
 extern DevPrivateKeyRec amdgpu_pixmap_index;
@@ -56,6 +67,39 @@ static inline void amdgpu_set_pixmap_private(PixmapPtr pixmap,
 	dixSetPrivate(&pixmap->devPrivates, &amdgpu_pixmap_index, priv);
 }
 
+/* Drop the cached DRI3 export, which is stale once the pixmap storage changes */
+static inline void amdgpu_pixmap_invalidate_export(struct amdgpu_pixmap *priv)
+{
+	int i;
+
+	for (i = 0; i < priv->num_export_fds; i++)
+		close(priv->export_fds[i]);
+
+	if (priv->export_list.next)
+		xorg_list_del(&priv->export_list);
+
+	priv->num_export_fds = 0;
+	priv->export_size = 0;
+	priv->export_bo = NULL;
+}
+
+/*
+ * Pixmaps which have an FB are linked into a per-screen list, so that all FBs
+ * can be released without walking every pixmap on the server
+ */
+static inline void amdgpu_pixmap_track_fb(ScrnInfoPtr scrn,
+					  struct amdgpu_pixmap *priv)
+{
+	if (!priv->fb_list.next || xorg_list_is_empty(&priv->fb_list))
+		xorg_list_add(&priv->fb_list, &AMDGPUPTR(scrn)->fb_pixmaps);
+}
+
+static inline void amdgpu_pixmap_untrack_fb(struct amdgpu_pixmap *priv)
+{
+	if (priv->fb_list.next)
+		xorg_list_del(&priv->fb_list);
+}
+
 static inline Bool amdgpu_set_pixmap_bo(PixmapPtr pPix, struct amdgpu_buffer *bo)
 {
 	ScrnInfoPtr scrn = xf86ScreenToScrn(pPix->drawable.pScreen);
@@ -75,7 +119,9 @@ static inline Bool amdgpu_set_pixmap_bo(PixmapPtr pPix, struct amdgpu_buffer *bo
 			priv->handle_valid = FALSE;
 		}
 
+		amdgpu_pixmap_invalidate_export(priv);
 		drmmode_fb_reference(pAMDGPUEnt->fd, &priv->fb, NULL);
+		amdgpu_pixmap_untrack_fb(priv);
 
 		if (!bo) {
 			free(priv);
@@ -153,13 +199,35 @@ amdgpu_pixmap_get_fb(PixmapPtr pix)
 		ScrnInfoPtr scrn = xf86ScreenToScrn(pix->drawable.pScreen);
 		AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(scrn);
 
+		struct amdgpu_buffer *bo = amdgpu_get_pixmap_bo(pix);
+
 		if (!fb_ptr)
 			fb_ptr = amdgpu_pixmap_get_fb_ptr(pix);
 
-		*fb_ptr = amdgpu_fb_create(scrn, pAMDGPUEnt->fd,
-					   pix->drawable.width,
-					   pix->drawable.height, pix->devKind,
-					   handle);
+		/* Pixmaps sharing an imported BO can share its FB as well */
+		if (bo && amdgpu_import_cache_get_fb(bo)) {
+			drmmode_fb_reference(pAMDGPUEnt->fd, fb_ptr,
+					     amdgpu_import_cache_get_fb(bo));
+			amdgpu_pixmap_track_fb(scrn, amdgpu_get_pixmap_private(pix));
+			return *fb_ptr;
+		}
+
+		if (bo && (bo->flags & AMDGPU_BO_FLAGS_MODIFIER))
+			*fb_ptr = amdgpu_fb_create_with_modifier(scrn, bo,
+								 pix->drawable.width,
+								 pix->drawable.height);
+		else
+			*fb_ptr = amdgpu_fb_create(scrn, pAMDGPUEnt->fd,
+						   pix->drawable.width,
+						   pix->drawable.height,
+						   pix->devKind, handle);
+
+		if (*fb_ptr) {
+			amdgpu_pixmap_track_fb(scrn, amdgpu_get_pixmap_private(pix));
+
+			if (bo)
+				amdgpu_import_cache_set_fb(bo, *fb_ptr);
+		}
 	}
 
 	return fb_ptr ? *fb_ptr : NULL;
@@ -314,7 +314,10 @@ amdgpu_present_check_flip(RRCrtcPtr crtc, WindowPtr window, PixmapPtr pixmap,
 
 /*
  * Once the flip has been completed on all CRTCs, notify the
- * extension code telling it when that happened
+ * extension code telling it when that happened. The extension code
+ * then treats the previously flipped pixmap as idle and signals its
+ * explicit sync release point, so this must not happen before the old
+ * FB has stopped being scanned out on every CRTC.
  */
 static void
 amdgpu_present_flip_event(xf86CrtcPtr crtc, uint32_t msc, uint64_t ust, void *pageflip_data)
@@ -476,6 +479,31 @@ amdgpu_present_has_async_flip(ScreenPtr screen)
 	return FALSE;
 }
 
+/*
+ * Explicit sync via DRI3 syncobjs relies on the kernel signalling eventfds
+ * when syncobj points are signaled
+ */
+static Bool
+amdgpu_present_has_syncobj(ScreenPtr screen)
+{
+#if defined(PresentCapabilitySyncobj) && defined(DRM_IOCTL_SYNCOBJ_EVENTFD)
+	ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
+	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(scrn);
+	struct drm_syncobj_eventfd args = { .fd = -1 };
+	uint64_t value;
+
+	if (drmGetCap(pAMDGPUEnt->fd, DRM_CAP_SYNCOBJ_TIMELINE, &value) != 0 ||
+	    !value)
+		return FALSE;
+
+	/* If the ioctl is supported, it fails with ENOENT for handle 0 */
+	return drmIoctl(pAMDGPUEnt->fd, DRM_IOCTL_SYNCOBJ_EVENTFD, &args) != 0 &&
+		errno == ENOENT;
+#else
+	return FALSE;
+#endif
+}
+
 Bool
 amdgpu_present_screen_init(ScreenPtr screen)
 {
@@ -487,6 +515,13 @@ amdgpu_present_screen_init(ScreenPtr screen)
 		info->can_async_flip = TRUE;
 	}
 
+#ifdef PresentCapabilitySyncobj
+	if (amdgpu_present_has_syncobj(screen)) {
+		amdgpu_present_screen_info.capabilities |= PresentCapabilitySyncobj;
+		info->explicit_sync = TRUE;
+	}
+#endif
+
 	if (!present_screen_init(screen, &amdgpu_present_screen_info)) {
 		xf86DrvMsg(xf86ScreenToScrn(screen)->scrnIndex, X_WARNING,
 			   "Present extension disabled because present_screen_init failed\n");
@@ -42,6 +42,7 @@
  */
 
 #include "amdgpu_probe.h"
+#include "amdgpu_timing.h"
 #include "amdgpu_version.h"
 #include "amdgpu_drv.h"
 
@@ -246,6 +247,7 @@ amdgpu_probe(ScrnInfoPtr pScrn, int entity_num,
 	EntityInfoPtr pEnt = NULL;
 	DevUnion *pPriv;
 	AMDGPUEntPtr pAMDGPUEnt;
+	uint64_t start;
 
 	if (!pScrn)
 		return FALSE;
@@ -281,8 +283,10 @@ amdgpu_probe(ScrnInfoPtr pScrn, int entity_num,
 			goto error;
 
 		pAMDGPUEnt = pPriv->ptr;
+		start = amdgpu_timing_begin();
 		if (!amdgpu_device_setup(pScrn, pci_dev, dev, pAMDGPUEnt))
 			goto error;
+		amdgpu_timing_end(pAMDGPUEnt, AMDGPU_PHASE_PROBE, start);
 
 		pAMDGPUEnt->fd_ref = 1;
 
@@ -52,6 +52,42 @@
 
 extern DriverRec AMDGPU;
 
+enum amdgpu_mem_domain {
+	AMDGPU_MEM_VRAM,
+	AMDGPU_MEM_GTT,
+	AMDGPU_MEM_NUM_DOMAINS
+};
+
+/* Memory usage accounting, shared by all screens of an entity */
+struct amdgpu_mem_stats {
+	uint64_t allocated[AMDGPU_MEM_NUM_DOMAINS];	/* bytes allocated by the driver */
+	uint64_t usage[AMDGPU_MEM_NUM_DOMAINS];		/* bytes in use by all processes, as reported by the kernel */
+	uint64_t size[AMDGPU_MEM_NUM_DOMAINS];		/* heap sizes, as reported by the kernel */
+	uint64_t num_steered;				/* pixmaps moved to GTT due to VRAM pressure */
+	CARD32 query_time;				/* last time usage was queried from the kernel */
+	Bool vram_pressure;
+};
+
+enum amdgpu_startup_phase {
+	AMDGPU_PHASE_PROBE,
+	AMDGPU_PHASE_PREINIT,
+	AMDGPU_PHASE_ACCEL_PREINIT,
+	AMDGPU_PHASE_DRMMODE_PREINIT,
+	AMDGPU_PHASE_SCREENINIT,
+	AMDGPU_PHASE_DRI2,
+	AMDGPU_PHASE_DRI3,
+	AMDGPU_PHASE_GLAMOR,
+	AMDGPU_PHASE_VIDEO,
+	AMDGPU_PHASE_SET_MODES,
+	AMDGPU_PHASE_NUM
+};
+
+/* Time spent in each server startup phase, shared by all screens of an entity */
+struct amdgpu_startup_timing {
+	uint64_t ns[AMDGPU_PHASE_NUM];
+	unsigned int count[AMDGPU_PHASE_NUM];
+};
+
 typedef struct {
 	Bool HasCRTC2;		/* All cards except original Radeon  */
 	Bool has_page_flip_target;
@@ -68,6 +104,9 @@ typedef struct {
 	struct xf86_platform_device *platform_dev;
 	char *render_node;
 	char *busid;
+	struct amdgpu_mem_stats mem_stats;
+	struct amdgpu_startup_timing startup_timing;
+	struct drmmode_mode_cache_entry *mode_cache;	/* EDID / mode list cache, most recently used first */
 } AMDGPUEntRec, *AMDGPUEntPtr;
 
 extern void amdgpu_kernel_close_fd(AMDGPUEntPtr pAMDGPUEnt);
@@ -22,6 +22,12 @@
  */
 #include <xorg-server.h>
 
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
 #include "amdgpu_drv.h"
 
 #include "misync.h"
@@ -32,27 +38,144 @@
 
 /*
  * This whole file exists to wrap a sync fence trigger operation
- * so that we can flush the batch buffer to provide serialization
- * between the server and the shm fence client
+ * so that the fence only becomes triggered once the GPU has finished
+ * all rendering submitted before the trigger request. This provides
+ * serialization between the server and the shm fence client.
  */
 
 static DevPrivateKeyRec amdgpu_sync_fence_private_key;
 
 typedef struct _amdgpu_sync_fence_private {
         SyncFenceSetTriggeredFunc set_triggered;
+        SyncFenceResetFunc reset;
+        /* sync_file fd the pending trigger is waiting for, or -1 */
+        int fence_fd;
 } amdgpu_sync_fence_private;
 
 #define SYNC_FENCE_PRIV(pFence)                                         \
         (amdgpu_sync_fence_private *) dixLookupPrivate(&pFence->devPrivates, &amdgpu_sync_fence_private_key)
 
+static PFNEGLCREATESYNCKHRPROC amdgpu_egl_create_sync;
+static PFNEGLDESTROYSYNCKHRPROC amdgpu_egl_destroy_sync;
+static PFNEGLDUPNATIVEFENCEFDANDROIDPROC amdgpu_egl_dup_native_fence_fd;
+
+/* Check if the EGL implementation can export fences as sync_file fds */
+static Bool
+amdgpu_sync_native_fence_init(ScrnInfoPtr scrn, EGLDisplay display)
+{
+	/* All screens are driven by the same EGL implementation */
+	static int supported = -1;
+	const char *extensions;
+
+	if (supported >= 0)
+		return supported;
+
+	extensions = eglQueryString(display, EGL_EXTENSIONS);
+	if (extensions && strstr(extensions, "EGL_ANDROID_native_fence_sync")) {
+		amdgpu_egl_create_sync = (PFNEGLCREATESYNCKHRPROC)
+			eglGetProcAddress("eglCreateSyncKHR");
+		amdgpu_egl_destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)
+			eglGetProcAddress("eglDestroySyncKHR");
+		amdgpu_egl_dup_native_fence_fd = (PFNEGLDUPNATIVEFENCEFDANDROIDPROC)
+			eglGetProcAddress("eglDupNativeFenceFDANDROID");
+	}
+
+	supported = amdgpu_egl_create_sync && amdgpu_egl_destroy_sync &&
+		amdgpu_egl_dup_native_fence_fd;
+	if (!supported) {
+		xf86DrvMsg(scrn->scrnIndex, X_INFO,
+			   "EGL_ANDROID_native_fence_sync unavailable, SYNC "
+			   "extension fences only flush pending rendering\n");
+	}
+
+	return supported;
+}
+
+/* Flush pending rendering operations, and return a sync_file fd which
+ * signals once they have completed, or -1 if that isn't possible
+ */
+static int
+amdgpu_sync_flush_fence_fd(ScrnInfoPtr scrn)
+{
+	EGLDisplay display;
+	EGLSyncKHR sync;
+	int fd;
+
+	/* This also makes the glamor context current */
+	amdgpu_glamor_flush(scrn);
+
+	if (!AMDGPUPTR(scrn)->use_glamor)
+		return -1;
+
+	display = eglGetCurrentDisplay();
+	if (display == EGL_NO_DISPLAY ||
+	    !amdgpu_sync_native_fence_init(scrn, display))
+		return -1;
+
+	sync = amdgpu_egl_create_sync(display, EGL_SYNC_NATIVE_FENCE_ANDROID,
+				      NULL);
+	if (sync == EGL_NO_SYNC_KHR)
+		return -1;
+
+	/* The fence fd can only be retrieved once the fence was flushed */
+	amdgpu_glamor_flush(scrn);
+	fd = amdgpu_egl_dup_native_fence_fd(display, sync);
+	amdgpu_egl_destroy_sync(display, sync);
+
+	return fd == EGL_NO_NATIVE_FENCE_FD_ANDROID ? -1 : fd;
+}
+
+static void
+amdgpu_sync_fence_cancel(amdgpu_sync_fence_private *private)
+{
+	if (private->fence_fd < 0)
+		return;
+
+	RemoveNotifyFd(private->fence_fd);
+	close(private->fence_fd);
+	private->fence_fd = -1;
+}
+
+static void amdgpu_sync_fence_set_triggered(SyncFence *fence);
+
+/* Trigger the fence and fire the triggers waiting for it */
+static void
+amdgpu_sync_fence_notify(int fd, int ready, void *data)
+{
+	SyncFence *fence = data;
+	amdgpu_sync_fence_private *private = SYNC_FENCE_PRIV(fence);
+
+	amdgpu_sync_fence_cancel(private);
+
+	fence->funcs.SetTriggered = private->set_triggered;
+	miSyncTriggerFence(fence);
+	private->set_triggered = fence->funcs.SetTriggered;
+	fence->funcs.SetTriggered = amdgpu_sync_fence_set_triggered;
+}
+
 static void
 amdgpu_sync_fence_set_triggered (SyncFence *fence)
 {
 	ScreenPtr screen = fence->pScreen;
 	amdgpu_sync_fence_private *private = SYNC_FENCE_PRIV(fence);
+	struct pollfd pfd;
 
-	/* Flush pending rendering operations */
-	amdgpu_glamor_flush(xf86ScreenToScrn(screen));
+	amdgpu_sync_fence_cancel(private);
+
+	pfd.fd = amdgpu_sync_flush_fence_fd(xf86ScreenToScrn(screen));
+	pfd.events = POLLIN;
+
+	/* If the GPU is still busy, defer the trigger until it's done */
+	if (pfd.fd >= 0) {
+		if (poll(&pfd, 1, 0) == 0 &&
+		    SetNotifyFd(pfd.fd, amdgpu_sync_fence_notify,
+				X_NOTIFY_READ, fence)) {
+			private->fence_fd = pfd.fd;
+			return;
+		}
+
+		close(pfd.fd);
+	}
 
 	fence->funcs.SetTriggered = private->set_triggered;
 	fence->funcs.SetTriggered(fence);
@@ -60,6 +183,20 @@ amdgpu_sync_fence_set_triggered (SyncFence *fence)
 	fence->funcs.SetTriggered = amdgpu_sync_fence_set_triggered;
 }
 
+static void
+amdgpu_sync_fence_reset(SyncFence *fence)
+{
+	amdgpu_sync_fence_private *private = SYNC_FENCE_PRIV(fence);
+
+	/* A pending trigger is superseded by the reset */
+	amdgpu_sync_fence_cancel(private);
+
+	fence->funcs.Reset = private->reset;
+	fence->funcs.Reset(fence);
+	private->reset = fence->funcs.Reset;
+	fence->funcs.Reset = amdgpu_sync_fence_reset;
+}
+
 static void
 amdgpu_sync_create_fence(ScreenPtr screen,
                         SyncFence *fence,
@@ -77,6 +214,24 @@ amdgpu_sync_create_fence(ScreenPtr screen,
 
 	private->set_triggered = fence->funcs.SetTriggered;
 	fence->funcs.SetTriggered = amdgpu_sync_fence_set_triggered;
+	private->reset = fence->funcs.Reset;
+	fence->funcs.Reset = amdgpu_sync_fence_reset;
+	private->fence_fd = -1;
+}
+
+static void
+amdgpu_sync_destroy_fence(ScreenPtr screen, SyncFence *fence)
+{
+	ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
+	AMDGPUInfoPtr info = AMDGPUPTR(scrn);
+	SyncScreenFuncsPtr screen_funcs = miSyncGetScreenFuncs(screen);
+
+	amdgpu_sync_fence_cancel(SYNC_FENCE_PRIV(fence));
+
+	screen_funcs->DestroyFence = info->DestroyFence;
+	screen_funcs->DestroyFence(screen, fence);
+	info->DestroyFence = screen_funcs->DestroyFence;
+	screen_funcs->DestroyFence = amdgpu_sync_destroy_fence;
 }
 
 Bool
@@ -117,6 +272,8 @@ amdgpu_sync_init(ScreenPtr screen)
 	screen_funcs = miSyncGetScreenFuncs(screen);
 	info->CreateFence = screen_funcs->CreateFence;
 	screen_funcs->CreateFence = amdgpu_sync_create_fence;
+	info->DestroyFence = screen_funcs->DestroyFence;
+	screen_funcs->DestroyFence = amdgpu_sync_destroy_fence;
 	return TRUE;
 }
 
@@ -129,6 +286,9 @@ amdgpu_sync_close(ScreenPtr screen)
 
 	if (screen_funcs && info->CreateFence)
 		screen_funcs->CreateFence = info->CreateFence;
+	if (screen_funcs && info->DestroyFence)
+		screen_funcs->DestroyFence = info->DestroyFence;
 
 	info->CreateFence = NULL;
+	info->DestroyFence = NULL;
 }
@@ -0,0 +1,98 @@
+/*
+ * Copyright © 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+#include <xorg-server.h>
+
+#include <string.h>
+#include <time.h>
+
+#include "amdgpu_drv.h"
+#include "amdgpu_timing.h"
+
+static const char *amdgpu_startup_phase_names[AMDGPU_PHASE_NUM] = {
+	[AMDGPU_PHASE_PROBE] = "Device probe",
+	[AMDGPU_PHASE_PREINIT] = "PreInit",
+	[AMDGPU_PHASE_ACCEL_PREINIT] = "  Acceleration / EGL",
+	[AMDGPU_PHASE_DRMMODE_PREINIT] = "  KMS outputs / CRTCs",
+	[AMDGPU_PHASE_SCREENINIT] = "ScreenInit",
+	[AMDGPU_PHASE_DRI2] = "  DRI2",
+	[AMDGPU_PHASE_DRI3] = "  DRI3 / Present",
+	[AMDGPU_PHASE_GLAMOR] = "  glamor",
+	[AMDGPU_PHASE_VIDEO] = "  Xv",
+	[AMDGPU_PHASE_SET_MODES] = "Initial modeset",
+};
+
+uint64_t
+amdgpu_timing_begin(void)
+{
+	struct timespec now;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+		return 0;
+
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void
+amdgpu_timing_end(AMDGPUEntPtr pAMDGPUEnt, enum amdgpu_startup_phase phase,
+		  uint64_t start)
+{
+	struct amdgpu_startup_timing *timing = &pAMDGPUEnt->startup_timing;
+	uint64_t end = amdgpu_timing_begin();
+
+	if (!start || end < start)
+		return;
+
+	timing->ns[phase] += end - start;
+	timing->count[phase]++;
+}
+
+void
+amdgpu_timing_log(ScrnInfoPtr pScrn)
+{
+	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(pScrn);
+	struct amdgpu_startup_timing *timing = &pAMDGPUEnt->startup_timing;
+	int i;
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO, "Startup phase timing:\n");
+
+	for (i = 0; i < AMDGPU_PHASE_NUM; i++) {
+		if (!timing->count[i])
+			continue;
+
+		if (timing->count[i] > 1) {
+			xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+				   "  %-24s %8.3f ms (%u times)\n",
+				   amdgpu_startup_phase_names[i],
+				   timing->ns[i] / 1000000.0, timing->count[i]);
+		} else {
+			xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+				   "  %-24s %8.3f ms\n",
+				   amdgpu_startup_phase_names[i],
+				   timing->ns[i] / 1000000.0);
+		}
+	}
+
+	memset(timing, 0, sizeof(*timing));
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright © 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef AMDGPU_TIMING_H
+#define AMDGPU_TIMING_H
+
+#include "amdgpu_probe.h"
+
+/* Start timing a startup phase. Returns a monotonic timestamp to pass to
+ * amdgpu_timing_end
+ */
+uint64_t amdgpu_timing_begin(void);
+
+/* Account the time since start to the given startup phase */
+void amdgpu_timing_end(AMDGPUEntPtr pAMDGPUEnt,
+		       enum amdgpu_startup_phase phase, uint64_t start);
+
+/* Log the time spent in each startup phase so far, and reset the counters */
+void amdgpu_timing_log(ScrnInfoPtr pScrn);
+
+#endif /* AMDGPU_TIMING_H */
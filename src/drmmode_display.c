@@ -39,8 +39,10 @@
 #include "xf86cmap.h"
 #include "xf86Priv.h"
 #include <xf86drm.h>
+#include <drm_fourcc.h>
 
 #include "drmmode_display.h"
+#include "drmmode_lut.h"
 #include "amdgpu_bo_helper.h"
 #include "amdgpu_glamor.h"
 #include "amdgpu_pixmap.h"
@@ -452,8 +454,8 @@ void drmmode_copy_fb(ScrnInfoPtr pScrn, drmmode_ptr drmmode)
 	return;
 }
 
-void
-drmmode_crtc_scanout_free(xf86CrtcPtr crtc)
+static void
+drmmode_crtc_scanout_abort_update(xf86CrtcPtr crtc)
 {
 	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
 
@@ -463,6 +465,37 @@ drmmode_crtc_scanout_free(xf86CrtcPtr crtc)
 		drmmode_crtc->scanout_update_pending = 0;
 		amdgpu_drm_queue_handle_deferred(crtc);
 	}
+}
+
+/*
+ * Stop updating the scanout pixmaps while the VT is switched away, but keep
+ * them along with their damage tracking, so that only the areas which changed
+ * in the meantime need to be updated when switching back
+ */
+void
+drmmode_crtc_scanout_suspend(xf86CrtcPtr crtc)
+{
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+
+	drmmode_crtc_scanout_abort_update(crtc);
+
+	drmmode_crtc->vt_scanout_valid =
+		drmmode_crtc->scanout[drmmode_crtc->scanout_id] &&
+		drmmode_crtc->scanout_damage &&
+		!crtc->driverIsPerformingTransform;
+	drmmode_crtc->vt_tear_free = drmmode_crtc->tear_free;
+	drmmode_crtc->vt_mode = crtc->mode;
+	drmmode_crtc->vt_x = crtc->x;
+	drmmode_crtc->vt_y = crtc->y;
+}
+
+void
+drmmode_crtc_scanout_free(xf86CrtcPtr crtc)
+{
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+
+	drmmode_crtc_scanout_abort_update(crtc);
+	drmmode_crtc->vt_scanout_valid = FALSE;
 
 	drmmode_crtc_scanout_destroy(&drmmode_crtc->scanout[0]);
 	drmmode_crtc_scanout_destroy(&drmmode_crtc->scanout[1]);
@@ -653,6 +686,22 @@ drmmode_crtc_scanout_update(xf86CrtcPtr crtc, DisplayModePtr mode,
 	ScrnInfoPtr scrn = crtc->scrn;
 	ScreenPtr screen = scrn->pScreen;
 	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	BoxRec extents = { .x1 = 0, .y1 = 0,
+			   .x2 = scrn->virtualX, .y2 = scrn->virtualY };
+
+	/* When returning from a VT switch with an unchanged configuration, the
+	 * scanout pixmaps still have the previous contents, so only the areas
+	 * damaged in the meantime need to be updated
+	 */
+	if (drmmode_crtc->vt_scanout_valid &&
+	    drmmode_crtc->vt_tear_free == drmmode_crtc->tear_free &&
+	    drmmode_crtc->vt_x == crtc->x && drmmode_crtc->vt_y == crtc->y &&
+	    xf86ModesEqual(&drmmode_crtc->vt_mode, mode) &&
+	    !crtc->driverIsPerformingTransform &&
+	    drmmode_crtc->scanout[scanout_id] &&
+	    drmmode_crtc->scanout_damage)
+		extents = *RegionExtents(DamageRegion(drmmode_crtc->scanout_damage));
+	drmmode_crtc->vt_scanout_valid = FALSE;
 
 	drmmode_crtc_scanout_create(crtc, &drmmode_crtc->scanout[scanout_id],
 				    mode->HDisplay, mode->VDisplay);
@@ -665,9 +714,6 @@ drmmode_crtc_scanout_update(xf86CrtcPtr crtc, DisplayModePtr mode,
 	if (drmmode_crtc->scanout[scanout_id] &&
 	    (!drmmode_crtc->tear_free ||
 	     drmmode_crtc->scanout[scanout_id ^ 1])) {
-		BoxRec extents = { .x1 = 0, .y1 = 0,
-				   .x2 = scrn->virtualX, .y2 = scrn->virtualY };
-
 		if (!drmmode_crtc->scanout_damage) {
 			drmmode_crtc->scanout_damage =
 				DamageCreate(amdgpu_screen_damage_report,
@@ -717,148 +763,146 @@ static enum drmmode_cm_prop get_cm_enum_from_str(const char *prop_name)
 	return CM_INVALID_PROP;
 }
 
-/**
- * If legacy LUT is a, and non-legacy LUT is b, then the result of b(a(x)) is
- * returned in out_lut. out_lut's length is expected to be the same as the
- * non-legacy LUT b.
- *
- * @a_(red|green|blue): The red, green, and blue components of the legacy LUT.
- * @b_lut: The non-legacy LUT, in DRM's color LUT format.
- * @out_lut: The composed LUT, in DRM's color LUT format.
- * @len_a: Length of legacy lut.
- * @len_b: Length of non-legacy lut.
+/* FNV-1a hash, for detecting unchanged data which can be reused */
+static uint32_t
+drmmode_hash(uint32_t hash, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+/* Number of gamma LUT blobs remembered per screen */
+#define DRMMODE_LUT_BLOB_CACHE_SIZE 8
+
+/*
+ * DRM blob for a gamma LUT composed from a legacy LUT and a non-legacy LUT.
+ * CRTCs using the same LUTs share the blob, and the LUTs only need to be
+ * composed again when they change.
  */
-static void drmmode_lut_compose(uint16_t *a_red,
-				uint16_t *a_green,
-				uint16_t *a_blue,
-				struct drm_color_lut *b_lut,
-				struct drm_color_lut *out_lut,
-				uint32_t len_a, uint32_t len_b)
-{
-	uint32_t i_l, i_r, i;
-	uint32_t i_amax, i_bmax;
-	uint32_t coeff_ibmax;
-	uint32_t j;
-	uint64_t a_out_ibmax;
-	int color;
-	size_t struct_size = sizeof(struct drm_color_lut);
-
-	uint32_t max_lut = (1 << 16) - 1;
-
-	i_amax = len_a - 1;
-	i_bmax = len_b - 1;
-
-	/* A linear interpolation is done on the legacy LUT before it is
-	 * composed, to bring it up-to-size with the non-legacy LUT. The
-	 * interpolation uses integers by keeping things multiplied until the
-	 * last moment.
-	 */
-	for (color = 0; color < 3; color++) {
-		uint16_t *a, *b, *out;
+struct drmmode_lut_blob {
+	struct drmmode_lut_blob *next;
+	uint32_t hash;
+	size_t key_size;
+	void *key;		/* see drmmode_lut_blob_key */
+	uint32_t blob_id;
+};
 
-		/* Set the initial pointers to the right color components. The
-		 * inner for-loop will then maintain the correct offset from
-		 * the initial element.
-		 */
-		if (color == 0) {
-			a = a_red;
-			b = &b_lut[0].red;
-			out = &out_lut[0].red;
-		} else if (color == 1) {
-			a = a_green;
-			b = &b_lut[0].green;
-			out = &out_lut[0].green;
-		} else {
-			a = a_blue;
-			b = &b_lut[0].blue;
-			out = &out_lut[0].blue;
-		}
+static void
+drmmode_lut_blob_free(int fd, struct drmmode_lut_blob *lut_blob)
+{
+	if (lut_blob->blob_id)
+		drmModeDestroyPropertyBlob(fd, lut_blob->blob_id);
+	free(lut_blob->key);
+	free(lut_blob);
+}
 
-		for (i = 0; i < len_b; i++) {
-			/* i_l and i_r tracks the left and right elements in
-			 * a_lut, to the sample point i. Also handle last
-			 * element edge case, when i_l = i_amax.
-			 */
-			i_l = i * i_amax / i_bmax;
-			i_r = i_l + !!(i_amax - i_l);
-
-			/* coeff is intended to be in [0, 1), depending on
-			 * where sample i is between i_l and i_r. We keep it
-			 * multiplied with i_bmax throughout to maintain
-			 * precision */
-			coeff_ibmax = (i * i_amax) - (i_l * i_bmax);
-			a_out_ibmax = i_bmax * a[i_l] +
-				      coeff_ibmax * (a[i_r] - a[i_l]);
-
-			/* j = floor((a_out/max_lut)*i_bmax).
-			 * i.e. the element in LUT b that a_out maps to. We
-			 * have to divide by max_lut to normalize a_out, since
-			 * values in the LUTs are [0, 1<<16)
-			 */
-			j = a_out_ibmax / max_lut;
-			*(uint16_t*)((char*)out + (i*struct_size)) =
-				*(uint16_t*)((char*)b + (j*struct_size));
-		}
+static void
+drmmode_lut_blob_cache_fini(int fd, drmmode_ptr drmmode)
+{
+	struct drmmode_lut_blob *lut_blob;
+
+	while ((lut_blob = drmmode->gamma_lut_blobs)) {
+		drmmode->gamma_lut_blobs = lut_blob->next;
+		drmmode_lut_blob_free(fd, lut_blob);
 	}
+}
+
+/* The LUT sizes, followed by the legacy LUT and the non-legacy LUT, if any */
+static void *
+drmmode_lut_blob_key(xf86CrtcPtr crtc, struct drm_color_lut *lut,
+		     uint32_t lut_size, size_t *key_size)
+{
+	size_t legacy_bytes = crtc->gamma_size * sizeof(uint16_t);
+	size_t lut_bytes = lut ? lut_size * sizeof(*lut) : 0;
+	uint32_t header[3] = { crtc->gamma_size, lut_size, lut != NULL };
+	char *key;
+
+	*key_size = sizeof(header) + 3 * legacy_bytes + lut_bytes;
+	key = malloc(*key_size);
+	if (!key)
+		return NULL;
 
-	for (i = 0; i < len_b; i++)
-		out_lut[i].reserved = 0;
+	memcpy(key, header, sizeof(header));
+	memcpy(key + sizeof(header), crtc->gamma_red, legacy_bytes);
+	memcpy(key + sizeof(header) + legacy_bytes, crtc->gamma_green,
+	       legacy_bytes);
+	memcpy(key + sizeof(header) + 2 * legacy_bytes, crtc->gamma_blue,
+	       legacy_bytes);
+	if (lut)
+		memcpy(key + sizeof(header) + 3 * legacy_bytes, lut, lut_bytes);
+
+	return key;
 }
 
-/**
- * Resize a LUT, using linear interpolation.
- *
- * @in_(red|green|blue): Legacy LUT components
- * @out_lut: The resized LUT is returned here, in DRM color LUT format.
- * @len_in: Length of legacy LUT.
- * @len_out: Length of out_lut, i.e. the target size.
+/*
+ * Look up the gamma LUT blob for the CRTC's current LUTs. If there is none
+ * yet, a new entry without a blob is added, which the caller can store the
+ * new blob in.
  */
-static void drmmode_lut_interpolate(uint16_t *in_red,
-				    uint16_t *in_green,
-				    uint16_t *in_blue,
-				    struct drm_color_lut *out_lut,
-				    uint32_t len_in, uint32_t len_out)
-{
-	uint32_t i_l, i_r, i;
-	uint32_t i_amax, i_bmax;
-	uint32_t coeff_ibmax;
-	uint64_t out_ibmax;
-	int color;
-	size_t struct_size = sizeof(struct drm_color_lut);
-
-	i_amax = len_in - 1;
-	i_bmax = len_out - 1;
-
-	/* See @drmmode_lut_compose for details */
-	for (color = 0; color < 3; color++) {
-		uint16_t *in, *out;
-
-		if (color == 0) {
-			in = in_red;
-			out = &out_lut[0].red;
-		} else if (color == 1) {
-			in = in_green;
-			out = &out_lut[0].green;
-		} else {
-			in = in_blue;
-			out = &out_lut[0].blue;
-		}
+static struct drmmode_lut_blob *
+drmmode_lut_blob_lookup(xf86CrtcPtr crtc, struct drm_color_lut *lut)
+{
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	drmmode_ptr drmmode = drmmode_crtc->drmmode;
+	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(crtc->scrn);
+	struct drmmode_lut_blob **prev, *lut_blob;
+	size_t key_size;
+	uint32_t hash;
+	void *key;
+	int i;
+
+	key = drmmode_lut_blob_key(crtc, lut, drmmode->gamma_lut_size,
+				   &key_size);
+	if (!key)
+		return NULL;
 
-		for (i = 0; i < len_out; i++) {
-			i_l = i * i_amax / i_bmax;
-			i_r = i_l + !!(i_amax - i_l);
+	hash = drmmode_hash(2166136261u, key, key_size);
 
-			coeff_ibmax = (i * i_amax) - (i_l * i_bmax);
-			out_ibmax = i_bmax * in[i_l] +
-				      coeff_ibmax * (in[i_r] - in[i_l]);
+	for (prev = &drmmode->gamma_lut_blobs; (lut_blob = *prev);
+	     prev = &lut_blob->next) {
+		if (lut_blob->hash != hash || lut_blob->key_size != key_size ||
+		    memcmp(lut_blob->key, key, key_size) != 0)
+			continue;
+
+		/* Move to the front of the list */
+		*prev = lut_blob->next;
+		lut_blob->next = drmmode->gamma_lut_blobs;
+		drmmode->gamma_lut_blobs = lut_blob;
+		free(key);
+		return lut_blob;
+	}
 
-			*(uint16_t*)((void*)out + (i*struct_size)) =
-				out_ibmax / i_bmax;
+	lut_blob = calloc(1, sizeof(*lut_blob));
+	if (!lut_blob) {
+		free(key);
+		return NULL;
+	}
+
+	lut_blob->hash = hash;
+	lut_blob->key = key;
+	lut_blob->key_size = key_size;
+	lut_blob->next = drmmode->gamma_lut_blobs;
+	drmmode->gamma_lut_blobs = lut_blob;
+
+	/* Drop the least recently used entries */
+	for (i = 1, prev = &lut_blob->next; *prev; i++) {
+		if (i < DRMMODE_LUT_BLOB_CACHE_SIZE) {
+			prev = &(*prev)->next;
+			continue;
 		}
+
+		lut_blob = *prev;
+		*prev = lut_blob->next;
+		drmmode_lut_blob_free(pAMDGPUEnt->fd, lut_blob);
 	}
 
-	for (i = 0; i < len_out; i++)
-		out_lut[i].reserved = 0;
+	return drmmode->gamma_lut_blobs;
 }
 
 /**
@@ -1078,6 +1122,7 @@ static int drmmode_crtc_push_cm_prop(xf86CrtcPtr crtc,
 	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
 	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(crtc->scrn);
 	drmmode_ptr drmmode = drmmode_crtc->drmmode;
+	struct drmmode_lut_blob *lut_blob = NULL;
 	Bool free_blob_data = FALSE;
 	uint32_t created_blob_id = 0;
 	uint32_t drm_prop_id;
@@ -1103,6 +1148,12 @@ static int drmmode_crtc_push_cm_prop(xf86CrtcPtr crtc,
 			goto do_push;
 		}
 
+		lut_blob = drmmode_lut_blob_lookup(crtc, drmmode_crtc->gamma_lut);
+		if (lut_blob && lut_blob->blob_id) {
+			created_blob_id = lut_blob->blob_id;
+			goto set_prop;
+		}
+
 		blob_data = malloc(expected_bytes);
 		if (!blob_data)
 			return BadAlloc;
@@ -1154,8 +1205,12 @@ do_push:
 				free(blob_data);
 			return BadRequest;
 		}
+
+		if (lut_blob)
+			lut_blob->blob_id = created_blob_id;
 	}
 
+set_prop:
 	drm_prop_id = drmmode_crtc->drmmode->cm_prop_ids[cm_prop_index];
 	ret = drmModeObjectSetProperty(pAMDGPUEnt->fd,
 				       drmmode_crtc->mode_crtc->crtc_id,
@@ -1164,9 +1219,9 @@ do_push:
 				       (uint64_t)created_blob_id);
 
 	/* If successful, kernel will have a reference already. Safe to destroy
-	 * the blob either way.
+	 * the blob either way, unless it's cached for reuse.
 	 */
-	if (blob_data)
+	if (blob_data && !lut_blob)
 		drmModeDestroyPropertyBlob(pAMDGPUEnt->fd, created_blob_id);
 
 	if (ret) {
@@ -1207,6 +1262,138 @@ drmmode_crtc_gamma_do_set(xf86CrtcPtr crtc, uint16_t *red, uint16_t *green,
 			   ret);
 }
 
+static Bool
+drmmode_kmode_timings_equal(const drmModeModeInfo *a, const drmModeModeInfo *b)
+{
+	return a->clock == b->clock &&
+		a->hdisplay == b->hdisplay &&
+		a->hsync_start == b->hsync_start &&
+		a->hsync_end == b->hsync_end &&
+		a->htotal == b->htotal &&
+		a->hskew == b->hskew &&
+		a->vdisplay == b->vdisplay &&
+		a->vsync_start == b->vsync_start &&
+		a->vsync_end == b->vsync_end &&
+		a->vtotal == b->vtotal &&
+		a->vscan == b->vscan &&
+		a->flags == b->flags;
+}
+
+/* Whether the kernel currently reports a link failure for the connector */
+static Bool
+drmmode_output_link_status_bad(int fd, drmmode_output_private_ptr drmmode_output)
+{
+	drmModeObjectPropertiesPtr props;
+	uint32_t prop_id = 0;
+	Bool bad = FALSE;
+	int i;
+
+	for (i = 0; i < drmmode_output->num_props; i++) {
+		drmModePropertyPtr mode_prop = drmmode_output->props[i].mode_prop;
+
+		if (!strcmp(mode_prop->name, "link-status")) {
+			prop_id = mode_prop->prop_id;
+			break;
+		}
+	}
+
+	if (!prop_id)
+		return FALSE;
+
+	props = drmModeObjectGetProperties(fd,
+					   drmmode_output->mode_output->connector_id,
+					   DRM_MODE_OBJECT_CONNECTOR);
+	if (!props)
+		return TRUE;
+
+	for (i = 0; i < props->count_props; i++) {
+		if (props->props[i] == prop_id) {
+			bad = props->prop_values[i] == DRM_MODE_LINK_STATUS_BAD;
+			break;
+		}
+	}
+
+	drmModeFreeObjectProperties(props);
+	return bad;
+}
+
+/*
+ * Check if the CRTC is already scanning out the given mode at the given
+ * position to exactly the given connectors, from a framebuffer with the same
+ * format, e.g. as set up by fbcon or a boot splash. If so, only the
+ * framebuffer needs to be replaced, which avoids blanking the displays and
+ * retraining links. Connectors with a failed link need a full modeset to
+ * retrain it.
+ */
+static Bool
+drmmode_crtc_state_matches(xf86CrtcPtr crtc, drmModeModeInfo *kmode,
+			   int x, int y, uint32_t *output_ids, int output_count)
+{
+	ScrnInfoPtr scrn = crtc->scrn;
+	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(scrn);
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(scrn);
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	uint32_t crtc_id = drmmode_crtc->mode_crtc->crtc_id;
+	drmModeCrtcPtr kcrtc;
+	drmModeFBPtr kfb = NULL;
+	Bool ret = FALSE;
+	int i, j;
+
+	kcrtc = drmModeGetCrtc(pAMDGPUEnt->fd, crtc_id);
+	if (!kcrtc)
+		return FALSE;
+
+	if (!kcrtc->mode_valid || !kcrtc->buffer_id ||
+	    kcrtc->x != x || kcrtc->y != y ||
+	    !drmmode_kmode_timings_equal(&kcrtc->mode, kmode))
+		goto out;
+
+	kfb = drmModeGetFB(pAMDGPUEnt->fd, kcrtc->buffer_id);
+	if (!kfb || kfb->depth != scrn->depth ||
+	    kfb->bpp != scrn->bitsPerPixel)
+		goto out;
+
+	for (i = 0; i < xf86_config->num_output; i++) {
+		drmmode_output_private_ptr drmmode_output =
+			xf86_config->output[i]->driver_private;
+		drmModeConnectorPtr koutput = drmmode_output->mode_output;
+		drmModeEncoderPtr kencoder;
+		Bool routed = FALSE, wanted = FALSE;
+
+		if (!koutput)
+			continue;
+
+		for (j = 0; j < output_count; j++) {
+			if (output_ids[j] == koutput->connector_id)
+				wanted = TRUE;
+		}
+
+		if (koutput->encoder_id) {
+			kencoder = drmModeGetEncoder(pAMDGPUEnt->fd,
+						     koutput->encoder_id);
+			if (kencoder) {
+				routed = kencoder->crtc_id == crtc_id;
+				drmModeFreeEncoder(kencoder);
+			}
+		}
+
+		if (routed != wanted)
+			goto out;
+
+		if (wanted &&
+		    drmmode_output_link_status_bad(pAMDGPUEnt->fd,
+						   drmmode_output))
+			goto out;
+	}
+
+	ret = TRUE;
+
+out:
+	drmModeFreeFB(kfb);
+	drmModeFreeCrtc(kcrtc);
+	return ret;
+}
+
 Bool
 drmmode_set_mode(xf86CrtcPtr crtc, struct drmmode_fb *fb, DisplayModePtr mode,
 		 int x, int y)
@@ -1242,10 +1429,25 @@ drmmode_set_mode(xf86CrtcPtr crtc, struct drmmode_fb *fb, DisplayModePtr mode,
 
 	drmmode_ConvertToKMode(scrn, &kmode, mode);
 
-	ret = drmModeSetCrtc(pAMDGPUEnt->fd,
-			     drmmode_crtc->mode_crtc->crtc_id,
-			     fb->handle, x, y, output_ids,
-			     output_count, &kmode) == 0;
+	if (drmmode_crtc->drmmode->fb_only_takeover &&
+	    drmmode_crtc_state_matches(crtc, &kmode, x, y, output_ids,
+				       output_count) &&
+	    drmModePageFlip(pAMDGPUEnt->fd, drmmode_crtc->mode_crtc->crtc_id,
+			    fb->handle, 0, NULL) == 0) {
+		/* Let the flip complete, so that it can't make the next one
+		 * fail with EBUSY, and the previous FB is no longer scanned out
+		 */
+		drmmode_wait_vblank(crtc, DRM_VBLANK_RELATIVE, 1, 0, NULL, NULL);
+		xf86DrvMsgVerb(scrn->scrnIndex, X_INFO, AMDGPU_LOGLEVEL_DEBUG,
+			       "Replaced FB on CRTC %u without a modeset\n",
+			       drmmode_crtc->mode_crtc->crtc_id);
+		ret = TRUE;
+	} else {
+		ret = drmModeSetCrtc(pAMDGPUEnt->fd,
+				     drmmode_crtc->mode_crtc->crtc_id,
+				     fb->handle, x, y, output_ids,
+				     output_count, &kmode) == 0;
+	}
 
 	if (ret) {
 		drmmode_fb_reference(pAMDGPUEnt->fd, &drmmode_crtc->fb, fb);
@@ -1414,6 +1616,47 @@ static void drmmode_set_cursor_position(xf86CrtcPtr crtc, int x, int y)
 	drmModeMoveCursor(pAMDGPUEnt->fd, drmmode_crtc->mode_crtc->crtc_id, x, y);
 }
 
+/*
+ * Whether legacy gamma needs to be applied to the cursor image by the CPU,
+ * i.e. when the kernel doesn't support the non-legacy gamma LUT
+ */
+static Bool
+drmmode_cursor_needs_gamma(xf86CrtcPtr crtc)
+{
+	AMDGPUInfoPtr info = AMDGPUPTR(crtc->scrn);
+
+	return (crtc->scrn->depth == 24 || crtc->scrn->depth == 32) &&
+		!drmmode_cm_prop_supported(&info->drmmode, CM_GAMMA_LUT);
+}
+
+/*
+ * Tables for un-premultiplying and premultiplying 8-bit color channels by
+ * alpha, indexed by [alpha][channel], to avoid per-pixel divisions when
+ * applying gamma to the cursor image
+ */
+static uint8_t drmmode_cursor_unpremul[256][256];
+static uint8_t drmmode_cursor_premul[256][256];
+
+static void
+drmmode_cursor_tables_init(void)
+{
+	static Bool initialized;
+	uint32_t alpha, c;
+
+	if (initialized)
+		return;
+
+	for (alpha = 0; alpha < 256; alpha++) {
+		for (c = 0; c < 256; c++) {
+			drmmode_cursor_premul[alpha][c] = c * alpha / 0xff;
+			drmmode_cursor_unpremul[alpha][c] =
+				alpha ? min(c * 0xff / alpha, 0xff) : 0;
+		}
+	}
+
+	initialized = TRUE;
+}
+
 static Bool
 drmmode_cursor_pixel(xf86CrtcPtr crtc, uint32_t *argb, Bool *premultiplied,
 		     Bool *apply_gamma)
@@ -1447,7 +1690,7 @@ drmmode_cursor_pixel(xf86CrtcPtr crtc, uint32_t *argb, Bool *premultiplied,
 	if (premultiplied) {
 		/* Un-premultiply alpha */
 		for (i = 0; i < 3; i++)
-			rgb[i] = rgb[i] * 0xff / alpha;
+			rgb[i] = drmmode_cursor_unpremul[alpha][rgb[i]];
 	}
 
 	if (*apply_gamma) {
@@ -1458,35 +1701,144 @@ drmmode_cursor_pixel(xf86CrtcPtr crtc, uint32_t *argb, Bool *premultiplied,
 
 	/* Premultiply alpha */
 	for (i = 0; i < 3; i++)
-		rgb[i] = rgb[i] * alpha / 0xff;
+		rgb[i] = drmmode_cursor_premul[alpha][rgb[i]];
 
 	*argb = alpha << 24 | rgb[2] << 16 | rgb[1] << 8 | rgb[0];
 	return TRUE;
 }
 
+Bool
+drmmode_crtc_cursor_buffer_alloc(xf86CrtcPtr crtc, unsigned id)
+{
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	struct drmmode_cursor_buffer *buffer = &drmmode_crtc->cursor_buffer[id];
+	ScrnInfoPtr pScrn = crtc->scrn;
+	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(pScrn);
+	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
+	int cursor_size = info->cursor_w * info->cursor_h * 4;
+
+	if (buffer->bo)
+		return TRUE;
+
+	buffer->bo = amdgpu_bo_open(pAMDGPUEnt->pDev,
+				    AMDGPU_ALIGN(cursor_size,
+						 AMDGPU_GPU_PAGE_SIZE),
+				    0, AMDGPU_GEM_DOMAIN_VRAM);
+	if (!buffer->bo)
+		return FALSE;
+
+	if (amdgpu_bo_cpu_map(buffer->bo->bo.amdgpu, &buffer->bo->cpu_ptr)) {
+		ErrorF("Failed to map cursor buffer memory\n");
+		amdgpu_bo_unref(&buffer->bo);
+		return FALSE;
+	}
+
+	buffer->bits = NULL;
+	return TRUE;
+}
+
+/*
+ * Look for a cursor BO which already holds the converted image. Animated
+ * cursors cycle through the same frames, which can then be shown without
+ * converting and uploading them again.
+ */
+static int
+drmmode_cursor_cache_lookup(xf86CrtcPtr crtc, CursorBitsPtr bits,
+			    uint32_t hash)
+{
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	AMDGPUInfoPtr info = AMDGPUPTR(crtc->scrn);
+	int i;
+
+	for (i = 0; i < info->cursor_cache_size; i++) {
+		struct drmmode_cursor_buffer *buffer =
+			&drmmode_crtc->cursor_buffer[i];
+
+		if (buffer->bits == bits && buffer->hash == hash &&
+		    buffer->gamma_serial == drmmode_crtc->cursor_gamma_serial)
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Pick the cursor BO to convert a new image into: an unused BO if one can
+ * be allocated, otherwise the least recently used one. The BO currently
+ * being scanned out is only reused when reloading the same cursor.
+ */
+static int
+drmmode_cursor_cache_victim(xf86CrtcPtr crtc, CursorPtr cursor)
+{
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	AMDGPUInfoPtr info = AMDGPUPTR(crtc->scrn);
+	int victim = -1;
+	int i;
+
+	if (drmmode_crtc->cursor == cursor)
+		return drmmode_crtc->cursor_id;
+
+	for (i = 0; i < info->cursor_cache_size; i++) {
+		struct drmmode_cursor_buffer *buffer =
+			&drmmode_crtc->cursor_buffer[i];
+
+		if (drmmode_crtc->cursor && i == drmmode_crtc->cursor_id)
+			continue;
+
+		if (!buffer->bo) {
+			if (drmmode_crtc_cursor_buffer_alloc(crtc, i))
+				return i;
+
+			continue;
+		}
+
+		if (!buffer->bits)
+			return i;
+
+		if (victim < 0 ||
+		    (int)(buffer->last_use -
+			  drmmode_crtc->cursor_buffer[victim].last_use) < 0)
+			victim = i;
+	}
+
+	return victim;
+}
+
 static void drmmode_load_cursor_argb(xf86CrtcPtr crtc, CARD32 * image)
 {
 	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
 	ScrnInfoPtr pScrn = crtc->scrn;
 	AMDGPUInfoPtr info = AMDGPUPTR(pScrn);
-	unsigned id = drmmode_crtc->cursor_id;
+	CursorPtr cursor = XF86_CRTC_CONFIG_PTR(pScrn)->cursor;
+	uint32_t cursor_size = info->cursor_w * info->cursor_h;
+	struct drmmode_cursor_buffer *buffer;
 	Bool premultiplied = TRUE;
-	Bool apply_gamma = TRUE;
-	uint32_t argb;
+	Bool apply_gamma = drmmode_cursor_needs_gamma(crtc);
+	uint32_t argb, hash;
 	uint32_t *ptr;
+	int id;
 
-	if ((crtc->scrn->depth != 24 && crtc->scrn->depth != 32) ||
-	    drmmode_cm_prop_supported(&info->drmmode, CM_GAMMA_LUT))
-		apply_gamma = FALSE;
+	hash = drmmode_hash(2166136261u, image, cursor_size * sizeof(uint32_t));
+	id = drmmode_cursor_cache_lookup(crtc, cursor->bits, hash);
+	if (id >= 0) {
+		buffer = &drmmode_crtc->cursor_buffer[id];
+		goto done;
+	}
 
-	if (drmmode_crtc->cursor &&
-	    XF86_CRTC_CONFIG_PTR(pScrn)->cursor != drmmode_crtc->cursor)
-		id ^= 1;
+	id = drmmode_cursor_cache_victim(crtc, cursor);
+	if (id < 0) {
+		/* No other BO is available, overwrite the one being shown */
+		id = drmmode_crtc->cursor_id;
+		if (!drmmode_crtc->cursor_buffer[id].bo)
+			return;
+	}
+	buffer = &drmmode_crtc->cursor_buffer[id];
+	ptr = (uint32_t *) (buffer->bo->cpu_ptr);
 
-	ptr = (uint32_t *) (drmmode_crtc->cursor_buffer[id]->cpu_ptr);
+	if (apply_gamma)
+		drmmode_cursor_tables_init();
 
 	{
-		uint32_t cursor_size = info->cursor_w * info->cursor_h;
 		int i;
 
 retry:
@@ -1500,9 +1852,20 @@ retry:
 		}
 	}
 
-	if (id != drmmode_crtc->cursor_id) {
+	buffer->bits = cursor->bits;
+	buffer->hash = hash;
+	buffer->gamma_serial = drmmode_crtc->cursor_gamma_serial;
+
+done:
+	buffer->last_use = ++drmmode_crtc->cursor_lru_clock;
+
+	/* If the cursor is hidden, it'll be shown from the new BO later */
+	if (drmmode_crtc->cursor &&
+	    (id != drmmode_crtc->cursor_id || drmmode_crtc->cursor != cursor)) {
 		drmmode_crtc->cursor_id = id;
 		crtc->funcs->show_cursor(crtc);
+	} else {
+		drmmode_crtc->cursor_id = id;
 	}
 }
 
@@ -1534,7 +1897,7 @@ static void drmmode_show_cursor(xf86CrtcPtr crtc)
 	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(pScrn);
 	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
 	struct amdgpu_buffer *cursor_buffer =
-		drmmode_crtc->cursor_buffer[drmmode_crtc->cursor_id];
+		drmmode_crtc->cursor_buffer[drmmode_crtc->cursor_id].bo;
 	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
 	CursorPtr cursor = xf86_config->cursor;
 	int xhot = cursor->bits->xhot;
@@ -1657,6 +2020,14 @@ drmmode_crtc_gamma_set(xf86CrtcPtr crtc, uint16_t * red, uint16_t * green,
 
 	drmmode_crtc_gamma_do_set(crtc, red, green, blue, size);
 
+	/* The cursor image only needs to be reloaded if gamma is applied to
+	 * it by the CPU
+	 */
+	if (!drmmode_cursor_needs_gamma(crtc))
+		return;
+
+	((drmmode_crtc_private_ptr)crtc->driver_private)->cursor_gamma_serial++;
+
 	/* Compute index of this CRTC into xf86_config->crtc */
 	for (i = 0; xf86_config->crtc[i] != crtc; i++) {}
 
@@ -1710,6 +2081,7 @@ static Bool drmmode_set_scanout_pixmap(xf86CrtcPtr crtc, PixmapPtr ppix)
 static void drmmode_crtc_destroy(xf86CrtcPtr crtc)
 {
 	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	int i;
 
 	drmModeFreeCrtc(drmmode_crtc->mode_crtc);
 
@@ -1719,6 +2091,13 @@ static void drmmode_crtc_destroy(xf86CrtcPtr crtc)
 	if (drmmode_crtc->ctm != NULL)
 		free(drmmode_crtc->ctm);
 
+	drmmode_free_formats(drmmode_crtc->formats, drmmode_crtc->num_formats);
+
+	for (i = 0; i < DRMMODE_CURSOR_CACHE_MAX; i++) {
+		if (drmmode_crtc->cursor_buffer[i].bo)
+			amdgpu_bo_unref(&drmmode_crtc->cursor_buffer[i].bo);
+	}
+
 	free(drmmode_crtc);
 	crtc->driver_private = NULL;
 }
@@ -1908,8 +2287,15 @@ static xf86OutputStatus drmmode_output_detect(xf86OutputPtr output)
 	xf86OutputStatus status;
 	drmModeFreeConnector(drmmode_output->mode_output);
 
-	drmmode_output->mode_output =
-	    drmModeGetConnector(pAMDGPUEnt->fd, drmmode_output->output_id);
+	if (drmmode_output->drmmode->probe_current) {
+		drmmode_output->mode_output =
+			drmModeGetConnectorCurrent(pAMDGPUEnt->fd,
+						   drmmode_output->output_id);
+	} else {
+		drmmode_output->mode_output =
+			drmModeGetConnector(pAMDGPUEnt->fd,
+					    drmmode_output->output_id);
+	}
 	if (!drmmode_output->mode_output) {
 		drmmode_output->output_id = -1;
 		return XF86OutputStatusDisconnected;
@@ -2005,32 +2391,170 @@ koutput_get_prop_idx(int fd, drmModeConnectorPtr koutput,
     return idx;
 }
 
-static int
-koutput_get_prop_id(int fd, drmModeConnectorPtr koutput,
-        int type, const char *name)
+/* Number of EDID / mode list combinations remembered per entity */
+#define DRMMODE_MODE_CACHE_SIZE 8
+
+/*
+ * Parsed EDID and converted mode list for a given EDID blob and kernel mode
+ * list. Re-probing an unchanged monitor only needs to hash and compare these
+ * and hand out copies, instead of parsing and converting everything again.
+ */
+struct drmmode_mode_cache_entry {
+	struct drmmode_mode_cache_entry *next;
+	uint32_t hash;
+	int adjust_flags;
+	uint8_t *edid;
+	uint32_t edid_len;
+	drmModeModeInfo *kmodes;
+	int num_kmodes;
+	xf86MonPtr mon;		/* rawData points to edid */
+	DisplayModePtr modes;
+};
+
+static void
+drmmode_mode_cache_entry_free(struct drmmode_mode_cache_entry *entry)
+{
+	while (entry->modes)
+		xf86DeleteMode(&entry->modes, entry->modes);
+	free(entry->mon);
+	free(entry->kmodes);
+	free(entry->edid);
+	free(entry);
+}
+
+void
+drmmode_mode_cache_fini(AMDGPUEntPtr pAMDGPUEnt)
 {
-    int idx = koutput_get_prop_idx(fd, koutput, type, name);
+	struct drmmode_mode_cache_entry *entry;
 
-    return (idx > -1) ? koutput->props[idx] : -1;
+	while ((entry = pAMDGPUEnt->mode_cache)) {
+		pAMDGPUEnt->mode_cache = entry->next;
+		drmmode_mode_cache_entry_free(entry);
+	}
+}
+
+static struct drmmode_mode_cache_entry *
+drmmode_mode_cache_lookup(ScrnInfoPtr scrn, drmModePropertyBlobPtr edid_blob,
+			  drmModeConnectorPtr koutput)
+{
+	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(scrn);
+	struct drmmode_mode_cache_entry **prev, *entry;
+	const void *edid = edid_blob ? edid_blob->data : NULL;
+	uint32_t edid_len = edid_blob ? edid_blob->length : 0;
+	size_t kmodes_size = koutput->count_modes * sizeof(drmModeModeInfo);
+	uint32_t hash;
+	int i;
+
+	hash = drmmode_hash(2166136261u, edid, edid_len);
+	hash = drmmode_hash(hash, koutput->modes, kmodes_size);
+
+	for (prev = &pAMDGPUEnt->mode_cache; (entry = *prev);
+	     prev = &entry->next) {
+		if (entry->hash != hash ||
+		    entry->adjust_flags != scrn->adjustFlags ||
+		    entry->edid_len != edid_len ||
+		    entry->num_kmodes != koutput->count_modes ||
+		    (edid_len && memcmp(entry->edid, edid, edid_len) != 0) ||
+		    (kmodes_size &&
+		     memcmp(entry->kmodes, koutput->modes, kmodes_size) != 0))
+			continue;
+
+		/* Move to the front of the list */
+		*prev = entry->next;
+		entry->next = pAMDGPUEnt->mode_cache;
+		pAMDGPUEnt->mode_cache = entry;
+		return entry;
+	}
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry)
+		return NULL;
+
+	entry->hash = hash;
+	entry->adjust_flags = scrn->adjustFlags;
+	entry->edid_len = edid_len;
+	entry->num_kmodes = koutput->count_modes;
+
+	if (edid_len) {
+		entry->edid = malloc(edid_len);
+		if (!entry->edid)
+			goto fail;
+		memcpy(entry->edid, edid, edid_len);
+
+		entry->mon = xf86InterpretEDID(scrn->scrnIndex, entry->edid);
+		if (entry->mon && edid_len > 128)
+			entry->mon->flags |= MONITOR_EDID_COMPLETE_RAWDATA;
+	}
+
+	if (kmodes_size) {
+		entry->kmodes = malloc(kmodes_size);
+		if (!entry->kmodes)
+			goto fail;
+		memcpy(entry->kmodes, koutput->modes, kmodes_size);
+	}
+
+	for (i = 0; i < koutput->count_modes; i++) {
+		DisplayModePtr mode = XNFalloc(sizeof(DisplayModeRec));
+
+		drmmode_ConvertFromKMode(scrn, &koutput->modes[i], mode);
+		entry->modes = xf86ModesAdd(entry->modes, mode);
+	}
+
+	entry->next = pAMDGPUEnt->mode_cache;
+	pAMDGPUEnt->mode_cache = entry;
+
+	/* Drop the least recently used entries */
+	for (i = 1, prev = &entry->next; *prev; i++) {
+		if (i < DRMMODE_MODE_CACHE_SIZE) {
+			prev = &(*prev)->next;
+			continue;
+		}
+
+		entry = *prev;
+		*prev = entry->next;
+		drmmode_mode_cache_entry_free(entry);
+	}
+
+	return pAMDGPUEnt->mode_cache;
+
+fail:
+	drmmode_mode_cache_entry_free(entry);
+	return NULL;
 }
 
 static drmModePropertyBlobPtr
-koutput_get_prop_blob(int fd, drmModeConnectorPtr koutput, const char *name)
+drmmode_output_get_edid_blob(xf86OutputPtr output)
 {
-    drmModePropertyBlobPtr blob = NULL;
-    int idx = koutput_get_prop_idx(fd, koutput, DRM_MODE_PROP_BLOB, name);
+	drmmode_output_private_ptr drmmode_output = output->driver_private;
+	drmModeConnectorPtr koutput = drmmode_output->mode_output;
+	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(output->scrn);
+	int idx;
+
+	/* Property IDs don't change, so only look up the EDID property by
+	 * name once instead of querying every property on each probe
+	 */
+	for (idx = 0; idx < koutput->count_props; idx++) {
+		if (koutput->props[idx] == drmmode_output->edid_prop_id)
+			break;
+	}
 
-    if (idx > -1)
-        blob = drmModeGetPropertyBlob(fd, koutput->prop_values[idx]);
+	if (!drmmode_output->edid_prop_id || idx == koutput->count_props) {
+		idx = koutput_get_prop_idx(pAMDGPUEnt->fd, koutput,
+					   DRM_MODE_PROP_BLOB, "EDID");
+		if (idx < 0)
+			return NULL;
 
-    return blob;
+		drmmode_output->edid_prop_id = koutput->props[idx];
+	}
+
+	return drmModeGetPropertyBlob(pAMDGPUEnt->fd, koutput->prop_values[idx]);
 }
 
 static DisplayModePtr drmmode_output_get_modes(xf86OutputPtr output)
 {
 	drmmode_output_private_ptr drmmode_output = output->driver_private;
 	drmModeConnectorPtr koutput = drmmode_output->mode_output;
-	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(output->scrn);
+	struct drmmode_mode_cache_entry *entry;
 	int i;
 	DisplayModePtr Modes = NULL, Mode;
 	xf86MonPtr mon = NULL;
@@ -2041,8 +2565,26 @@ static DisplayModePtr drmmode_output_get_modes(xf86OutputPtr output)
 	drmModeFreePropertyBlob(drmmode_output->edid_blob);
 
 	/* look for an EDID property */
-	drmmode_output->edid_blob =
-		koutput_get_prop_blob(pAMDGPUEnt->fd, koutput, "EDID");
+	drmmode_output->edid_blob = drmmode_output_get_edid_blob(output);
+
+	entry = drmmode_mode_cache_lookup(output->scrn,
+					  drmmode_output->edid_blob, koutput);
+	if (entry) {
+		/* xf86OutputSetEDID takes ownership of the monitor data */
+		if (entry->mon) {
+			mon = malloc(sizeof(*mon));
+			if (mon) {
+				memcpy(mon, entry->mon, sizeof(*mon));
+				mon->scrnIndex = output->scrn->scrnIndex;
+				mon->rawData = drmmode_output->edid_blob->data;
+			}
+		}
+		xf86OutputSetEDID(output, mon);
+
+		drmmode_output_attach_tile(output);
+
+		return xf86DuplicateModes(output->scrn, entry->modes);
+	}
 
 	if (drmmode_output->edid_blob) {
 		mon = xf86InterpretEDID(output->scrn->scrnIndex,
@@ -2552,6 +3094,41 @@ drmmode_create_name(ScrnInfoPtr pScrn, drmModeConnectorPtr koutput, char *name,
 }
 
 
+/*
+ * Look up the connector properties needed for output creation in a single
+ * pass, since each lookup requires a GETPROPERTY ioctl per property
+ */
+static void
+drmmode_output_find_props(int fd, drmModeConnectorPtr koutput, int *path_idx,
+			  int *non_desktop_idx, int *dpms_idx, int *edid_idx)
+{
+	int i;
+
+	*path_idx = *non_desktop_idx = *dpms_idx = *edid_idx = -1;
+
+	for (i = 0; i < koutput->count_props; i++) {
+		drmModePropertyPtr prop = drmModeGetProperty(fd, koutput->props[i]);
+
+		if (!prop)
+			continue;
+
+		if (drm_property_type_is(prop, DRM_MODE_PROP_BLOB)) {
+			if (!strcmp(prop->name, "PATH"))
+				*path_idx = i;
+			else if (!strcmp(prop->name, "EDID"))
+				*edid_idx = i;
+		} else if (drm_property_type_is(prop, DRM_MODE_PROP_RANGE)) {
+			if (!strcmp(prop->name, "non-desktop"))
+				*non_desktop_idx = i;
+		} else if (drm_property_type_is(prop, DRM_MODE_PROP_ENUM)) {
+			if (!strcmp(prop->name, "DPMS"))
+				*dpms_idx = i;
+		}
+
+		drmModeFreeProperty(prop);
+	}
+}
+
 static unsigned int
 drmmode_output_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode, drmModeResPtr mode_res, int num, int *num_dvi, int *num_hdmi, int dynamic)
 {
@@ -2565,21 +3142,36 @@ drmmode_output_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode, drmModeResPtr mode_r
 	drmModePropertyBlobPtr path_blob = NULL;
 	Bool nonDesktop = FALSE;
 	char name[32];
+	int path_idx, non_desktop_idx, dpms_idx, edid_idx;
 	int i;
 	const char *s;
 
+	/* The outputs are probed again by the detect hook before their modes
+	 * are used, so avoid forcing a (potentially slow) probe here unless the
+	 * kernel hasn't probed the connector yet
+	 */
 	koutput =
-	    drmModeGetConnector(pAMDGPUEnt->fd,
-				mode_res->connectors[num]);
+	    drmModeGetConnectorCurrent(pAMDGPUEnt->fd,
+				       mode_res->connectors[num]);
+	if (koutput && koutput->connection == DRM_MODE_UNKNOWNCONNECTION) {
+		drmModeFreeConnector(koutput);
+		koutput = NULL;
+	}
+	if (!koutput)
+		koutput = drmModeGetConnector(pAMDGPUEnt->fd,
+					      mode_res->connectors[num]);
 	if (!koutput)
 		return 0;
 
-	path_blob = koutput_get_prop_blob(pAMDGPUEnt->fd, koutput, "PATH");
+	drmmode_output_find_props(pAMDGPUEnt->fd, koutput, &path_idx,
+				  &non_desktop_idx, &dpms_idx, &edid_idx);
 
-	i = koutput_get_prop_idx(pAMDGPUEnt->fd, koutput, DRM_MODE_PROP_RANGE,
-				 "non-desktop");
-	if (i >= 0)
-        	nonDesktop = koutput->prop_values[i] != 0;
+	if (path_idx >= 0)
+		path_blob = drmModeGetPropertyBlob(pAMDGPUEnt->fd,
+						   koutput->prop_values[path_idx]);
+
+	if (non_desktop_idx >= 0)
+		nonDesktop = koutput->prop_values[non_desktop_idx] != 0;
 
 	kencoders = calloc(sizeof(drmModeEncoderPtr), koutput->count_encoders);
 	if (!kencoders) {
@@ -2664,8 +3256,9 @@ drmmode_output_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode, drmModeResPtr mode_r
 	output->possible_clones = 0;
 
 	drmmode_output->dpms_enum_id =
-		koutput_get_prop_id(pAMDGPUEnt->fd, koutput, DRM_MODE_PROP_ENUM,
-				    "DPMS");
+		dpms_idx >= 0 ? koutput->props[dpms_idx] : -1;
+	if (edid_idx >= 0)
+		drmmode_output->edid_prop_id = koutput->props[edid_idx];
 
 	if (dynamic) {
 		output->randr_output = RROutputCreate(xf86ScrnToScreen(pScrn), output->name, strlen(output->name), output);
@@ -3206,6 +3799,304 @@ static void drmmode_cm_init(int drm_fd, drmmode_ptr drmmode,
 	drmModeFreeObjectProperties(drm_props);
 }
 
+/*
+ * Returns the value of the named property of a DRM object, or 0 if the object
+ * doesn't have the property
+ */
+static uint64_t
+drmmode_get_object_prop_value(int fd, uint32_t object_id, uint32_t object_type,
+			      const char *name)
+{
+	drmModeObjectPropertiesPtr props;
+	drmModePropertyPtr prop;
+	uint64_t value = 0;
+	int i;
+
+	props = drmModeObjectGetProperties(fd, object_id, object_type);
+	if (!props)
+		return 0;
+
+	for (i = 0; i < props->count_props; i++) {
+		prop = drmModeGetProperty(fd, props->props[i]);
+		if (!prop)
+			continue;
+
+		if (strcmp(prop->name, name) == 0) {
+			value = props->prop_values[i];
+			drmModeFreeProperty(prop);
+			break;
+		}
+
+		drmModeFreeProperty(prop);
+	}
+
+	drmModeFreeObjectProperties(props);
+	return value;
+}
+
+/*
+ * Adds a format/modifier pair to an array of formats, unless it's already
+ * there. Returns FALSE on allocation failure.
+ */
+static Bool
+drmmode_format_add_modifier(struct drmmode_format **formats,
+			    uint32_t *num_formats, uint32_t format,
+			    uint64_t modifier)
+{
+	struct drmmode_format *new_formats, *fmt;
+	uint64_t *new_modifiers;
+	uint32_t i;
+
+	fmt = drmmode_find_format(*formats, *num_formats, format);
+	if (!fmt) {
+		new_formats = reallocarray(*formats, *num_formats + 1,
+					   sizeof(*new_formats));
+		if (!new_formats)
+			return FALSE;
+
+		*formats = new_formats;
+		fmt = &new_formats[(*num_formats)++];
+		fmt->format = format;
+		fmt->num_modifiers = 0;
+		fmt->modifiers = NULL;
+	}
+
+	for (i = 0; i < fmt->num_modifiers; i++) {
+		if (fmt->modifiers[i] == modifier)
+			return TRUE;
+	}
+
+	new_modifiers = reallocarray(fmt->modifiers, fmt->num_modifiers + 1,
+				     sizeof(*new_modifiers));
+	if (!new_modifiers)
+		return FALSE;
+
+	fmt->modifiers = new_modifiers;
+	fmt->modifiers[fmt->num_modifiers++] = modifier;
+	return TRUE;
+}
+
+/*
+ * Returns the entry for the given format in an array of formats, or NULL if
+ * the format isn't in it
+ */
+struct drmmode_format *
+drmmode_find_format(struct drmmode_format *formats, uint32_t num_formats,
+		    uint32_t format)
+{
+	uint32_t i;
+
+	for (i = 0; i < num_formats; i++) {
+		if (formats[i].format == format)
+			return &formats[i];
+	}
+
+	return NULL;
+}
+
+void
+drmmode_free_formats(struct drmmode_format *formats, uint32_t num_formats)
+{
+	uint32_t i;
+
+	for (i = 0; i < num_formats; i++)
+		free(formats[i].modifiers);
+
+	free(formats);
+}
+
+/*
+ * Adds the formats and modifiers listed in an IN_FORMATS property blob to
+ * an array of formats
+ */
+static void
+drmmode_add_in_formats(int fd, uint32_t blob_id,
+		       struct drmmode_format **formats, uint32_t *num_formats)
+{
+	drmModeFormatModifierIterator iter = { 0 };
+	drmModePropertyBlobPtr blob;
+
+	blob = drmModeGetPropertyBlob(fd, blob_id);
+	if (!blob)
+		return;
+
+	while (drmModeFormatModifierBlobIterNext(blob, &iter)) {
+		if (iter.mod == DRM_FORMAT_MOD_INVALID)
+			continue;
+
+		if (!drmmode_format_add_modifier(formats, num_formats,
+						 iter.fmt, iter.mod))
+			break;
+	}
+
+	drmModeFreePropertyBlob(blob);
+}
+
+/*
+ * Returns the bit corresponding to a CRTC in the possible_crtcs mask of planes
+ */
+static uint32_t
+drmmode_crtc_mask(drmModeResPtr mode_res, xf86CrtcPtr crtc)
+{
+	drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+	int i;
+
+	for (i = 0; i < mode_res->count_crtcs; i++) {
+		if (mode_res->crtcs[i] == drmmode_crtc->mode_crtc->crtc_id)
+			return 1 << i;
+	}
+
+	return 0;
+}
+
+/*
+ * Determines the formats and modifiers supported by the display hardware,
+ * based on the IN_FORMATS property of the planes:
+ *
+ * - For each CRTC, those of its primary plane, which determine what can be
+ *   scanned out directly from a window's buffer (see
+ *   amdgpu_dri3_get_drawable_modifiers)
+ * - For the screen, the union of those of all primary and overlay planes
+ *   usable with any of its CRTCs (see amdgpu_dri3_get_formats)
+ * - The modifiers which the primary planes of all CRTCs support for the front
+ *   buffer format. These are used for allocating scanout buffers, see
+ *   amdgpu_alloc_pixmap_bo.
+ */
+static void
+drmmode_planes_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode,
+		    drmModeResPtr mode_res)
+{
+	xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(pScrn);
+	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(pScrn);
+	uint32_t format = amdgpu_get_gbm_format(pScrn->depth,
+						pScrn->bitsPerPixel);
+	drmModePlaneResPtr plane_res;
+	drmModePlanePtr plane;
+	struct drmmode_format *crtc_format;
+	uint64_t *modifiers = NULL;
+	uint32_t num_modifiers = 0;
+	uint32_t in_formats, possible_crtcs;
+	uint64_t type;
+	int c, i, j, k;
+
+	if (drmSetClientCap(pAMDGPUEnt->fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1))
+		return;
+
+	plane_res = drmModeGetPlaneResources(pAMDGPUEnt->fd);
+	if (!plane_res)
+		return;
+
+	for (i = 0; i < plane_res->count_planes; i++) {
+		plane = drmModeGetPlane(pAMDGPUEnt->fd, plane_res->planes[i]);
+		if (!plane)
+			continue;
+
+		possible_crtcs = plane->possible_crtcs;
+		drmModeFreePlane(plane);
+
+		for (c = 0; c < xf86_config->num_crtc; c++) {
+			if (possible_crtcs &
+			    drmmode_crtc_mask(mode_res, xf86_config->crtc[c]))
+				break;
+		}
+		if (c == xf86_config->num_crtc)
+			continue;
+
+		type = drmmode_get_object_prop_value(pAMDGPUEnt->fd,
+						     plane_res->planes[i],
+						     DRM_MODE_OBJECT_PLANE,
+						     "type");
+		if (type != DRM_PLANE_TYPE_PRIMARY &&
+		    type != DRM_PLANE_TYPE_OVERLAY)
+			continue;
+
+		in_formats = drmmode_get_object_prop_value(pAMDGPUEnt->fd,
+							   plane_res->planes[i],
+							   DRM_MODE_OBJECT_PLANE,
+							   "IN_FORMATS");
+
+		if (in_formats) {
+			drmmode_add_in_formats(pAMDGPUEnt->fd, in_formats,
+					       &drmmode->formats,
+					       &drmmode->num_formats);
+		}
+
+		if (type != DRM_PLANE_TYPE_PRIMARY)
+			continue;
+
+		for (c = 0; c < xf86_config->num_crtc; c++) {
+			drmmode_crtc_private_ptr drmmode_crtc =
+				xf86_config->crtc[c]->driver_private;
+
+			if (!(possible_crtcs &
+			      drmmode_crtc_mask(mode_res, xf86_config->crtc[c])) ||
+			    drmmode_crtc->primary_plane_id)
+				continue;
+
+			drmmode_crtc->primary_plane_id = plane_res->planes[i];
+			if (in_formats) {
+				drmmode_add_in_formats(pAMDGPUEnt->fd, in_formats,
+						       &drmmode_crtc->formats,
+						       &drmmode_crtc->num_formats);
+			}
+		}
+	}
+
+	drmModeFreePlaneResources(plane_res);
+
+	if (format == ~0U)
+		return;
+
+	for (c = 0; c < xf86_config->num_crtc; c++) {
+		drmmode_crtc_private_ptr drmmode_crtc =
+			xf86_config->crtc[c]->driver_private;
+
+		crtc_format = drmmode_find_format(drmmode_crtc->formats,
+						  drmmode_crtc->num_formats,
+						  format);
+		if (!crtc_format) {
+			free(modifiers);
+			return;
+		}
+
+		if (c == 0) {
+			modifiers = malloc(crtc_format->num_modifiers *
+					   sizeof(*modifiers));
+			if (!modifiers)
+				return;
+
+			memcpy(modifiers, crtc_format->modifiers,
+			       crtc_format->num_modifiers * sizeof(*modifiers));
+			num_modifiers = crtc_format->num_modifiers;
+			continue;
+		}
+
+		/* Only keep modifiers supported by all CRTCs */
+		for (j = 0, k = 0; j < num_modifiers; j++) {
+			for (i = 0; i < crtc_format->num_modifiers; i++) {
+				if (modifiers[j] == crtc_format->modifiers[i]) {
+					modifiers[k++] = modifiers[j];
+					break;
+				}
+			}
+		}
+		num_modifiers = k;
+	}
+
+	/* Nothing to gain over the default allocation path with only linear */
+	if (num_modifiers == 0 ||
+	    (num_modifiers == 1 && modifiers[0] == DRM_FORMAT_MOD_LINEAR)) {
+		free(modifiers);
+		return;
+	}
+
+	drmmode->scanout_modifiers = modifiers;
+	drmmode->num_scanout_modifiers = num_modifiers;
+	xf86DrvMsgVerb(pScrn->scrnIndex, X_INFO, AMDGPU_LOGLEVEL_DEBUG,
+		       "%u scanout modifiers supported by all CRTCs\n",
+		       num_modifiers);
+}
+
 Bool drmmode_pre_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode, int cpp)
 {
 	AMDGPUEntPtr pAMDGPUEnt = AMDGPUEntPriv(pScrn);
@@ -3277,6 +4168,8 @@ Bool drmmode_pre_init(ScrnInfoPtr pScrn, drmmode_ptr drmmode, int cpp)
 	/* workout clones */
 	drmmode_clones_init(pScrn, drmmode, mode_res);
 
+	drmmode_planes_init(pScrn, drmmode, mode_res);
+
 	if (asprintf(&provider_name, "%s @ %s", pScrn->chipset, pAMDGPUEnt->busid) == -1) {
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR, "malloc failed\n");
 		return FALSE;
@@ -3320,6 +4213,8 @@ void drmmode_fini(ScrnInfoPtr pScrn, drmmode_ptr drmmode)
 	for (c = 0; c < config->num_crtc; c++)
 		drmmode_crtc_scanout_free(config->crtc[c]);
 
+	drmmode_lut_blob_cache_fini(pAMDGPUEnt->fd, drmmode);
+
 	if (pAMDGPUEnt->fd_wakeup_registered == serverGeneration &&
 	    !--pAMDGPUEnt->fd_wakeup_ref) {
 		RemoveNotifyFd(pAMDGPUEnt->fd);
@@ -3499,10 +4394,20 @@ Bool drmmode_set_desired_modes(ScrnInfoPtr pScrn, drmmode_ptr drmmode,
 		}
 
 		if (set_hw) {
-			if (crtc->funcs->set_mode_major(crtc, &crtc->desiredMode,
-							crtc->desiredRotation,
-							crtc->desiredX,
-							crtc->desiredY)) {
+			Bool ret;
+
+			/* At startup and on EnterVT, the kernel state may
+			 * already match, then only the FB needs replacing
+			 */
+			drmmode->fb_only_takeover = TRUE;
+			ret = crtc->funcs->set_mode_major(crtc,
+							  &crtc->desiredMode,
+							  crtc->desiredRotation,
+							  crtc->desiredX,
+							  crtc->desiredY);
+			drmmode->fb_only_takeover = FALSE;
+
+			if (ret) {
 				num_on++;
 			} else {
 				xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
@@ -3620,6 +4525,9 @@ drmmode_find_output(ScrnInfoPtr scrn, int output_id, int *num_dvi,
 }
 
 #ifdef HAVE_LIBUDEV
+/* How long to wait for more uevents before handling them */
+#define AMDGPU_HOTPLUG_DELAY_MS 50
+
 static void
 amdgpu_mode_hotplug(ScrnInfoPtr scrn, drmmode_ptr drmmode)
 {
@@ -3629,8 +4537,11 @@ amdgpu_mode_hotplug(ScrnInfoPtr scrn, drmmode_ptr drmmode)
 	int i, j;
 	Bool found;
 	Bool changed = FALSE;
+	Bool full = drmmode->hotplug_full;
 	int num_dvi = 0, num_hdmi = 0;
 
+	drmmode->hotplug_full = FALSE;
+
 	/* Try to re-set the mode on all the connectors with a BAD link-state:
 	 * This may happen if a link degrades and a new modeset is necessary, using
 	 * different link-training parameters. If the kernel found that the current
@@ -3645,6 +4556,18 @@ amdgpu_mode_hotplug(ScrnInfoPtr scrn, drmmode_ptr drmmode)
 		xf86CrtcPtr crtc = output->crtc;
 		drmmode_output_private_ptr drmmode_output = output->driver_private;
 
+		/* Only probe connectors the uevents were about, other
+		 * connectors' state is unchanged
+		 */
+		if (full || drmmode_output->hotplug_probe)
+			drmmode->probe_current = FALSE;
+		else if (drmmode_output->hotplug_refresh)
+			drmmode->probe_current = TRUE;
+		else
+			continue;
+
+		drmmode_output->hotplug_probe = FALSE;
+		drmmode_output->hotplug_refresh = FALSE;
 		drmmode_output_detect(output);
 
 		if (!crtc || !drmmode_output->mode_output)
@@ -3675,6 +4598,13 @@ amdgpu_mode_hotplug(ScrnInfoPtr scrn, drmmode_ptr drmmode)
 		}
 	}
 
+	/* All connectors are up to date now, don't probe them again below */
+	drmmode->probe_current = TRUE;
+
+	/* Connectors are only added or removed with untargeted uevents */
+	if (!full)
+		goto leases;
+
 	mode_res = drmModeGetResources(pAMDGPUEnt->fd);
 	if (!mode_res)
 		goto out;
@@ -3722,6 +4652,9 @@ restart_destroy:
 			changed = TRUE;
 	}
 
+	drmModeFreeResources(mode_res);
+
+leases:
 	/* Check to see if a lessee has disappeared */
 	drmmode_validate_leases(scrn);
 
@@ -3730,15 +4663,60 @@ restart_destroy:
 		RRTellChanged(xf86ScrnToScreen(scrn));
 	}
 
-	drmModeFreeResources(mode_res);
 out:
 	RRGetInfo(xf86ScrnToScreen(scrn), TRUE);
+	drmmode->probe_current = FALSE;
+}
+
+/* Record which connector a hotplug uevent is about */
+static void
+drmmode_hotplug_uevent(drmmode_ptr drmmode, struct udev_device *dev)
+{
+	xf86CrtcConfigPtr config = XF86_CRTC_CONFIG_PTR(drmmode->scrn);
+	const char *connector = udev_device_get_property_value(dev, "CONNECTOR");
+	const char *property = udev_device_get_property_value(dev, "PROPERTY");
+	char *end;
+	unsigned long id;
+	int i;
+
+	if (!connector)
+		goto full;
+
+	id = strtoul(connector, &end, 10);
+	if (end == connector || *end)
+		goto full;
+
+	for (i = 0; i < config->num_output; i++) {
+		drmmode_output_private_ptr drmmode_output =
+			config->output[i]->driver_private;
+
+		if (drmmode_output->output_id != id)
+			continue;
+
+		if (property)
+			drmmode_output->hotplug_refresh = TRUE;
+		else
+			drmmode_output->hotplug_probe = TRUE;
+		return;
+	}
+
+full:
+	drmmode->hotplug_full = TRUE;
+}
+
+static CARD32
+drmmode_hotplug_timer(OsTimerPtr timer, CARD32 now, void *data)
+{
+	drmmode_ptr drmmode = data;
+
+	drmmode->hotplug_pending = FALSE;
+	amdgpu_mode_hotplug(drmmode->scrn, drmmode);
+	return 0;
 }
 
 static void drmmode_handle_uevents(int fd, void *closure)
 {
 	drmmode_ptr drmmode = closure;
-	ScrnInfoPtr scrn = drmmode->scrn;
 	struct udev_device *dev;
 	Bool received = FALSE;
 	struct timeval tv = { 0, 0 };
@@ -3752,13 +4730,19 @@ static void drmmode_handle_uevents(int fd, void *closure)
 		/* select() ensured that this will not block */
 		dev = udev_monitor_receive_device(drmmode->uevent_monitor);
 		if (dev) {
+			drmmode_hotplug_uevent(drmmode, dev);
 			udev_device_unref(dev);
 			received = TRUE;
 		}
 	}
 
-	if (received)
-		amdgpu_mode_hotplug(scrn, drmmode);
+	if (received && !drmmode->hotplug_pending) {
+		drmmode->hotplug_timer =
+			TimerSet(drmmode->hotplug_timer, 0,
+				 AMDGPU_HOTPLUG_DELAY_MS,
+				 drmmode_hotplug_timer, drmmode);
+		drmmode->hotplug_pending = TRUE;
+	}
 }
 #endif
 
@@ -3800,6 +4784,9 @@ void drmmode_uevent_fini(ScrnInfoPtr scrn, drmmode_ptr drmmode)
 	if (drmmode->uevent_handler) {
 		struct udev *u = udev_monitor_get_udev(drmmode->uevent_monitor);
 		xf86RemoveGeneralHandler(drmmode->uevent_handler);
+		TimerFree(drmmode->hotplug_timer);
+		drmmode->hotplug_timer = NULL;
+		drmmode->hotplug_pending = FALSE;
 
 		udev_monitor_unref(drmmode->uevent_monitor);
 		udev_unref(u);
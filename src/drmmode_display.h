@@ -54,12 +54,32 @@ enum drmmode_cm_prop {
 	CM_INVALID_PROP = -1,
 };
 
+/* Pixel format supported by a DRM plane, with its modifiers */
+struct drmmode_format {
+	uint32_t format;
+	uint32_t num_modifiers;
+	uint64_t *modifiers;
+};
+
 typedef struct {
 	ScrnInfoPtr scrn;
 #ifdef HAVE_LIBUDEV
 	struct udev_monitor *uevent_monitor;
 	InputHandlerProc uevent_handler;
+	/* Delays handling of hotplug uevents, to merge bursts of them */
+	OsTimerPtr hotplug_timer;
+	Bool hotplug_pending;
+	/* A uevent didn't identify the connector, re-probe all of them */
+	Bool hotplug_full;
 #endif
+	/* drmmode_output_detect uses the kernel's current connector state
+	 * instead of forcing a probe
+	 */
+	Bool probe_current;
+	/* drmmode_set_mode may only replace the FB if the kernel CRTC state
+	 * already matches, see drmmode_set_desired_modes
+	 */
+	Bool fb_only_takeover;
 	drmEventContext event_context;
 	int count_crtcs;
 
@@ -74,6 +94,18 @@ typedef struct {
 	/* Lookup table sizes */
 	uint32_t degamma_lut_size;
 	uint32_t gamma_lut_size;
+	/* Gamma LUT blobs, most recently used first */
+	struct drmmode_lut_blob *gamma_lut_blobs;
+
+	/* Modifiers supported by the primary planes of all CRTCs for the
+	 * front buffer format
+	 */
+	uint64_t *scanout_modifiers;
+	uint32_t num_scanout_modifiers;
+
+	/* Formats supported by the primary and overlay planes of the screen */
+	struct drmmode_format *formats;
+	uint32_t num_formats;
 } drmmode_rec, *drmmode_ptr;
 
 typedef struct {
@@ -98,10 +130,31 @@ enum drmmode_scanout_status {
 	DRMMODE_SCANOUT_VBLANK_FAILED = 1u << 1,
 };
 
+/* Default and maximum value of the CursorCacheSize option */
+#define DRMMODE_CURSOR_CACHE_DEFAULT 8
+#define DRMMODE_CURSOR_CACHE_MAX 64
+
+/* Cursor BO, along with the cursor image it currently holds */
+struct drmmode_cursor_buffer {
+	struct amdgpu_buffer *bo;
+	/* Key of the image in the BO, NULL if none */
+	CursorBitsPtr bits;
+	/* Hash of the image passed to drmmode_load_cursor_argb, to verify
+	 * the key, since CursorBits memory may be reused
+	 */
+	uint32_t hash;
+	unsigned gamma_serial;
+	unsigned last_use;
+};
+
 typedef struct {
 	drmmode_ptr drmmode;
 	drmModeCrtcPtr mode_crtc;
 	int hw_id;
+	uint32_t primary_plane_id;
+	/* Formats supported by the primary plane */
+	struct drmmode_format *formats;
+	uint32_t num_formats;
 
 	CursorPtr cursor;
 	int cursor_x;
@@ -109,7 +162,11 @@ typedef struct {
 	int cursor_xhot;
 	int cursor_yhot;
 	unsigned cursor_id;
-	struct amdgpu_buffer *cursor_buffer[2];
+	struct drmmode_cursor_buffer cursor_buffer[DRMMODE_CURSOR_CACHE_MAX];
+	/* Incremented whenever the gamma applied to cursor images changes */
+	unsigned cursor_gamma_serial;
+	/* Incremented for each cursor image load, for LRU replacement */
+	unsigned cursor_lru_clock;
 
 	PixmapPtr rotate;
 	PixmapPtr scanout[2];
@@ -120,6 +177,11 @@ typedef struct {
 	uintptr_t scanout_update_pending;
 	Bool tear_free;
 	enum drmmode_scanout_status scanout_status;
+	/* CRTC configuration at LeaveVT, if the scanout pixmaps were kept */
+	Bool vt_scanout_valid;
+	Bool vt_tear_free;
+	DisplayModeRec vt_mode;
+	int vt_x, vt_y;
 	Bool vrr_enabled;
 
 	PixmapPtr prime_scanout_pixmap;
@@ -159,6 +221,7 @@ typedef struct {
 	drmModeConnectorPtr mode_output;
 	drmModeEncoderPtr *mode_encoders;
 	drmModePropertyBlobPtr edid_blob;
+	uint32_t edid_prop_id;
 	drmModePropertyBlobPtr tile_blob;
 	int dpms_enum_id;
 	int num_props;
@@ -166,6 +229,11 @@ typedef struct {
 	int enc_mask;
 	int enc_clone_mask;
 	int tear_free;
+	/* Pending hotplug uevent for this connector: connection change which
+	 * needs a probe, or property change which just needs a state update
+	 */
+	Bool hotplug_probe;
+	Bool hotplug_refresh;
 } drmmode_output_private_rec, *drmmode_output_private_ptr;
 
 typedef struct {
@@ -267,6 +335,8 @@ extern void drmmode_copy_fb(ScrnInfoPtr pScrn, drmmode_ptr drmmode);
 extern Bool drmmode_setup_colormap(ScreenPtr pScreen, ScrnInfoPtr pScrn);
 
 void drmmode_crtc_scanout_free(xf86CrtcPtr crtc);
+void drmmode_crtc_scanout_suspend(xf86CrtcPtr crtc);
+extern Bool drmmode_crtc_cursor_buffer_alloc(xf86CrtcPtr crtc, unsigned id);
 
 extern void drmmode_uevent_init(ScrnInfoPtr scrn, drmmode_ptr drmmode);
 extern void drmmode_uevent_fini(ScrnInfoPtr scrn, drmmode_ptr drmmode);
@@ -276,6 +346,12 @@ Bool drmmode_set_mode(xf86CrtcPtr crtc, struct drmmode_fb *fb,
 
 extern int drmmode_get_crtc_id(xf86CrtcPtr crtc);
 extern int drmmode_get_pitch_align(ScrnInfoPtr scrn, int bpe);
+extern struct drmmode_format *drmmode_find_format(struct drmmode_format *formats,
+						  uint32_t num_formats,
+						  uint32_t format);
+extern void drmmode_free_formats(struct drmmode_format *formats,
+				 uint32_t num_formats);
+extern void drmmode_mode_cache_fini(AMDGPUEntPtr pAMDGPUEnt);
 Bool amdgpu_do_pageflip(ScrnInfoPtr scrn, ClientPtr client,
 			PixmapPtr new_front, uint64_t id, void *data,
 			xf86CrtcPtr ref_crtc, amdgpu_drm_handler_proc handler,
@@ -0,0 +1,210 @@
+/*
+ * Copyright © 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Resampling of legacy gamma LUTs to the size of the non-legacy DRM color
+ * LUTs. This doesn't depend on the X server, so that it can be tested on its
+ * own, see test/lut_test.c.
+ */
+
+#include <stdint.h>
+
+#include "drmmode_lut.h"
+
+/*
+ * Precomputed divisor for exact division of 32-bit values by a run-time
+ * invariant, using a multiplication instead of a division per element. See
+ * "Division by Invariant Integers using Multiplication" (Granlund, Montgomery)
+ */
+struct drmmode_divisor {
+	uint32_t d;
+	uint32_t m;
+	int shift;
+};
+
+static void drmmode_divisor_init(struct drmmode_divisor *div, uint32_t d)
+{
+	int l = 0;
+
+	while ((1ull << l) < d)
+		l++;
+
+	div->d = d;
+	div->shift = l;
+	div->m = d > 1 ? ((1ull << 32) * ((1ull << l) - d)) / d + 1 : 0;
+}
+
+static inline uint32_t drmmode_divide(const struct drmmode_divisor *div,
+				      uint32_t n)
+{
+	uint32_t t;
+
+	if (div->d == 1)
+		return n;
+
+	t = ((uint64_t)div->m * n) >> 32;
+	return (t + ((n - t) >> 1)) >> (div->shift - 1);
+}
+
+/*
+ * Linearly interpolate the legacy LUT at the sample point between i_l and
+ * i_r, with the result multiplied by i_bmax. The intermediate values fit in
+ * 32 bits and may wrap around, but the result is always in range.
+ */
+static inline uint32_t drmmode_lut_sample_ibmax(const uint16_t *lut,
+						uint32_t i_l, uint32_t i_r,
+						uint32_t coeff_ibmax,
+						uint32_t i_bmax)
+{
+	return i_bmax * lut[i_l] + coeff_ibmax * (lut[i_r] - lut[i_l]);
+}
+
+/*
+ * Advance to the legacy LUT position of the next sample point, i.e.
+ * i_l = i * i_amax / i_bmax and coeff_ibmax = i * i_amax % i_bmax,
+ * without dividing
+ */
+static inline void drmmode_lut_step(uint32_t *i_l, uint32_t *coeff_ibmax,
+				    uint32_t i_amax, uint32_t i_bmax)
+{
+	*coeff_ibmax += i_amax;
+	while (*coeff_ibmax >= i_bmax) {
+		*coeff_ibmax -= i_bmax;
+		(*i_l)++;
+	}
+}
+
+/**
+ * If legacy LUT is a, and non-legacy LUT is b, then the result of b(a(x)) is
+ * returned in out_lut. out_lut's length is expected to be the same as the
+ * non-legacy LUT b.
+ *
+ * @a_(red|green|blue): The red, green, and blue components of the legacy LUT.
+ * @b_lut: The non-legacy LUT, in DRM's color LUT format.
+ * @out_lut: The composed LUT, in DRM's color LUT format.
+ * @len_a: Length of legacy lut.
+ * @len_b: Length of non-legacy lut.
+ */
+void drmmode_lut_compose(uint16_t *a_red,
+			 uint16_t *a_green,
+			 uint16_t *a_blue,
+			 struct drm_color_lut *b_lut,
+			 struct drm_color_lut *out_lut,
+			 uint32_t len_a, uint32_t len_b)
+{
+	uint32_t i_l = 0, i_r, i;
+	uint32_t i_amax, i_bmax;
+	uint32_t coeff_ibmax = 0;
+	struct drmmode_divisor max_lut;
+
+	drmmode_divisor_init(&max_lut, (1 << 16) - 1);
+
+	i_amax = len_a - 1;
+	i_bmax = len_b - 1;
+
+	/* A linear interpolation is done on the legacy LUT before it is
+	 * composed, to bring it up-to-size with the non-legacy LUT. The
+	 * interpolation uses integers by keeping things multiplied until the
+	 * last moment.
+	 */
+	for (i = 0; i < len_b; i++) {
+		/* i_l and i_r track the left and right elements in a_lut, to
+		 * the sample point i. Also handle last element edge case, when
+		 * i_l = i_amax.
+		 *
+		 * coeff is intended to be in [0, 1), depending on where sample
+		 * i is between i_l and i_r. We keep it multiplied with i_bmax
+		 * throughout to maintain precision.
+		 *
+		 * The index into LUT b is floor((a_out/max_lut)*i_bmax), i.e.
+		 * the element in LUT b that a_out maps to. We have to divide
+		 * by max_lut to normalize a_out, since values in the LUTs are
+		 * [0, 1<<16)
+		 */
+		i_r = i_l + !!(i_amax - i_l);
+
+		out_lut[i].red =
+			b_lut[drmmode_divide(&max_lut,
+					     drmmode_lut_sample_ibmax(a_red, i_l, i_r,
+								      coeff_ibmax,
+								      i_bmax))].red;
+		out_lut[i].green =
+			b_lut[drmmode_divide(&max_lut,
+					     drmmode_lut_sample_ibmax(a_green, i_l, i_r,
+								      coeff_ibmax,
+								      i_bmax))].green;
+		out_lut[i].blue =
+			b_lut[drmmode_divide(&max_lut,
+					     drmmode_lut_sample_ibmax(a_blue, i_l, i_r,
+								      coeff_ibmax,
+								      i_bmax))].blue;
+		out_lut[i].reserved = 0;
+
+		drmmode_lut_step(&i_l, &coeff_ibmax, i_amax, i_bmax);
+	}
+}
+
+/**
+ * Resize a LUT, using linear interpolation.
+ *
+ * @in_(red|green|blue): Legacy LUT components
+ * @out_lut: The resized LUT is returned here, in DRM color LUT format.
+ * @len_in: Length of legacy LUT.
+ * @len_out: Length of out_lut, i.e. the target size.
+ */
+void drmmode_lut_interpolate(uint16_t *in_red,
+			     uint16_t *in_green,
+			     uint16_t *in_blue,
+			     struct drm_color_lut *out_lut,
+			     uint32_t len_in, uint32_t len_out)
+{
+	uint32_t i_l = 0, i_r, i;
+	uint32_t i_amax, i_bmax;
+	uint32_t coeff_ibmax = 0;
+	struct drmmode_divisor ibmax;
+
+	i_amax = len_in - 1;
+	i_bmax = len_out - 1;
+	drmmode_divisor_init(&ibmax, i_bmax);
+
+	/* See @drmmode_lut_compose for details */
+	for (i = 0; i < len_out; i++) {
+		i_r = i_l + !!(i_amax - i_l);
+
+		out_lut[i].red =
+			drmmode_divide(&ibmax,
+				       drmmode_lut_sample_ibmax(in_red, i_l, i_r,
+								coeff_ibmax, i_bmax));
+		out_lut[i].green =
+			drmmode_divide(&ibmax,
+				       drmmode_lut_sample_ibmax(in_green, i_l, i_r,
+								coeff_ibmax, i_bmax));
+		out_lut[i].blue =
+			drmmode_divide(&ibmax,
+				       drmmode_lut_sample_ibmax(in_blue, i_l, i_r,
+								coeff_ibmax, i_bmax));
+		out_lut[i].reserved = 0;
+
+		drmmode_lut_step(&i_l, &coeff_ibmax, i_amax, i_bmax);
+	}
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright © 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Compares the ShadowFB front buffer update in amdgpu_kms.c, which copies the
+ * damaged rows with amdgpu_copy_to_wc(), against the row by row memcpy done
+ * by the X server's shadowUpdatePacked.
+ *
+ * The destination is ordinary cached memory here, since write-combined
+ * memory can only be mapped from a device. The streaming stores still skip
+ * reading destination cache lines and leave the source in the caches, but
+ * the difference to memcpy is larger on a real write-combined front buffer.
+ *
+ * Fails if a copy produces different contents than memcpy.
+ *
+ * Usage: copy_bench [iterations]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "amdgpu_copy.h"
+
+#define BENCH_CPP 4
+
+struct bench_box {
+	int x1, y1, x2, y2;
+};
+
+struct bench_case {
+	const char *name;
+	int width, height;
+	/* Damage boxes, in units of 1/16th of the screen size */
+	int nboxes;
+	struct bench_box boxes[4];
+};
+
+static const struct bench_case bench_cases[] = {
+	{ "1920x1080 full screen", 1920, 1080, 1,
+	  { { 0, 0, 16, 16 } } },
+	{ "3840x2160 full screen", 3840, 2160, 1,
+	  { { 0, 0, 16, 16 } } },
+	{ "3840x2160 four windows", 3840, 2160, 4,
+	  { { 1, 1, 7, 7 }, { 9, 1, 15, 7 },
+	    { 1, 9, 7, 15 }, { 9, 9, 15, 15 } } },
+	{ "3840x2160 text line", 3840, 2160, 1,
+	  { { 1, 8, 15, 9 } } },
+};
+
+static uint64_t
+bench_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Copy the damaged rows of each box, like shadowUpdatePacked */
+static void
+bench_update_memcpy(const struct bench_case *c, uint8_t *dst,
+		    const uint8_t *src, int stride)
+{
+	int i, y;
+
+	for (i = 0; i < c->nboxes; i++) {
+		const struct bench_box *box = &c->boxes[i];
+		int x1 = box->x1 * c->width / 16, x2 = box->x2 * c->width / 16;
+		int y1 = box->y1 * c->height / 16, y2 = box->y2 * c->height / 16;
+		size_t offset = x1 * BENCH_CPP;
+
+		for (y = y1; y < y2; y++)
+			memcpy(dst + y * stride + offset,
+			       src + y * stride + offset,
+			       (x2 - x1) * BENCH_CPP);
+	}
+}
+
+/* Copy the damaged rows of each box, like amdgpu_shadow_update_band */
+static void
+bench_update_wc(const struct bench_case *c, uint8_t *dst,
+		const uint8_t *src, int stride)
+{
+	int i, y;
+
+	for (i = 0; i < c->nboxes; i++) {
+		const struct bench_box *box = &c->boxes[i];
+		int x1 = box->x1 * c->width / 16, x2 = box->x2 * c->width / 16;
+		int y1 = box->y1 * c->height / 16, y2 = box->y2 * c->height / 16;
+		size_t offset = x1 * BENCH_CPP;
+
+		for (y = y1; y < y2; y++)
+			amdgpu_copy_to_wc(dst + y * stride + offset,
+					  src + y * stride + offset,
+					  (x2 - x1) * BENCH_CPP);
+	}
+
+	amdgpu_copy_to_wc_finish();
+}
+
+static int
+bench_run(const struct bench_case *c, int iterations)
+{
+	/* Offset the rows, to exercise the unaligned head and tail paths */
+	int stride = c->width * BENCH_CPP + 4;
+	size_t size = (size_t)stride * c->height;
+	uint8_t *src = malloc(size);
+	uint8_t *ref = malloc(size);
+	uint8_t *dst = malloc(size);
+	uint64_t start, memcpy_ns, wc_ns;
+	size_t i;
+	int n, ret = 0;
+
+	if (!src || !ref || !dst) {
+		fprintf(stderr, "Out of memory\n");
+		ret = 1;
+		goto out;
+	}
+
+	for (i = 0; i < size; i++)
+		src[i] = rand();
+	memset(ref, 0, size);
+	memset(dst, 0, size);
+
+	bench_update_memcpy(c, ref, src, stride);
+	bench_update_wc(c, dst, src, stride);
+	if (memcmp(ref, dst, size) != 0) {
+		fprintf(stderr, "%s: amdgpu_copy_to_wc result differs\n",
+			c->name);
+		ret = 1;
+		goto out;
+	}
+
+	start = bench_time_ns();
+	for (n = 0; n < iterations; n++)
+		bench_update_memcpy(c, ref, src, stride);
+	memcpy_ns = bench_time_ns() - start;
+
+	start = bench_time_ns();
+	for (n = 0; n < iterations; n++)
+		bench_update_wc(c, dst, src, stride);
+	wc_ns = bench_time_ns() - start;
+
+	printf("%-24s memcpy %8.3f ms  amdgpu_copy_to_wc %8.3f ms  (%.2fx)\n",
+	       c->name, memcpy_ns / 1000000.0 / iterations,
+	       wc_ns / 1000000.0 / iterations,
+	       wc_ns ? (double)memcpy_ns / wc_ns : 0.0);
+
+out:
+	free(src);
+	free(ref);
+	free(dst);
+	return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+	int iterations = 20;
+	int failed = 0;
+	size_t i;
+
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+	if (iterations < 1)
+		iterations = 1;
+
+	amdgpu_copy_init();
+	srand(1);
+
+	for (i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++)
+		failed |= bench_run(&bench_cases[i], iterations);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright © 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Checks the LUT resampling in src/drmmode_lut.c against the reference
+ * implementation it replaced, which used a division per element. The output
+ * must be bit-identical for every pair of LUT sizes the kernel and X server
+ * can hand us.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drmmode_lut.h"
+
+#define LUT_SIZE_MIN 2
+#define LUT_SIZE_MAX 4096
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/**
+ * If legacy LUT is a, and non-legacy LUT is b, then the result of b(a(x)) is
+ * returned in out_lut. out_lut's length is expected to be the same as the
+ * non-legacy LUT b.
+ *
+ * @a_(red|green|blue): The red, green, and blue components of the legacy LUT.
+ * @b_lut: The non-legacy LUT, in DRM's color LUT format.
+ * @out_lut: The composed LUT, in DRM's color LUT format.
+ * @len_a: Length of legacy lut.
+ * @len_b: Length of non-legacy lut.
+ */
+static void
+ref_lut_compose(uint16_t *a_red, uint16_t *a_green, uint16_t *a_blue,
+		struct drm_color_lut *b_lut, struct drm_color_lut *out_lut,
+		uint32_t len_a, uint32_t len_b)
+{
+	uint32_t i_l, i_r, i;
+	uint32_t i_amax, i_bmax;
+	uint32_t coeff_ibmax;
+	uint32_t j;
+	uint64_t a_out_ibmax;
+	int color;
+	size_t struct_size = sizeof(struct drm_color_lut);
+
+	uint32_t max_lut = (1 << 16) - 1;
+
+	i_amax = len_a - 1;
+	i_bmax = len_b - 1;
+
+	/* A linear interpolation is done on the legacy LUT before it is
+	 * composed, to bring it up-to-size with the non-legacy LUT. The
+	 * interpolation uses integers by keeping things multiplied until the
+	 * last moment.
+	 */
+	for (color = 0; color < 3; color++) {
+		uint16_t *a, *b, *out;
+
+		/* Set the initial pointers to the right color components. The
+		 * inner for-loop will then maintain the correct offset from
+		 * the initial element.
+		 */
+		if (color == 0) {
+			a = a_red;
+			b = &b_lut[0].red;
+			out = &out_lut[0].red;
+		} else if (color == 1) {
+			a = a_green;
+			b = &b_lut[0].green;
+			out = &out_lut[0].green;
+		} else {
+			a = a_blue;
+			b = &b_lut[0].blue;
+			out = &out_lut[0].blue;
+		}
+
+		for (i = 0; i < len_b; i++) {
+			/* i_l and i_r tracks the left and right elements in
+			 * a_lut, to the sample point i. Also handle last
+			 * element edge case, when i_l = i_amax.
+			 */
+			i_l = i * i_amax / i_bmax;
+			i_r = i_l + !!(i_amax - i_l);
+
+			/* coeff is intended to be in [0, 1), depending on
+			 * where sample i is between i_l and i_r. We keep it
+			 * multiplied with i_bmax throughout to maintain
+			 * precision */
+			coeff_ibmax = (i * i_amax) - (i_l * i_bmax);
+			a_out_ibmax = i_bmax * a[i_l] +
+				      coeff_ibmax * (a[i_r] - a[i_l]);
+
+			/* j = floor((a_out/max_lut)*i_bmax).
+			 * i.e. the element in LUT b that a_out maps to. We
+			 * have to divide by max_lut to normalize a_out, since
+			 * values in the LUTs are [0, 1<<16)
+			 */
+			j = a_out_ibmax / max_lut;
+			*(uint16_t*)((char*)out + (i*struct_size)) =
+				*(uint16_t*)((char*)b + (j*struct_size));
+		}
+	}
+
+	for (i = 0; i < len_b; i++)
+		out_lut[i].reserved = 0;
+}
+
+/**
+ * Resize a LUT, using linear interpolation.
+ *
+ * @in_(red|green|blue): Legacy LUT components
+ * @out_lut: The resized LUT is returned here, in DRM color LUT format.
+ * @len_in: Length of legacy LUT.
+ * @len_out: Length of out_lut, i.e. the target size.
+ */
+static void
+ref_lut_interpolate(uint16_t *in_red, uint16_t *in_green, uint16_t *in_blue,
+		    struct drm_color_lut *out_lut,
+		    uint32_t len_in, uint32_t len_out)
+{
+	uint32_t i_l, i_r, i;
+	uint32_t i_amax, i_bmax;
+	uint32_t coeff_ibmax;
+	uint64_t out_ibmax;
+	int color;
+	size_t struct_size = sizeof(struct drm_color_lut);
+
+	i_amax = len_in - 1;
+	i_bmax = len_out - 1;
+
+	/* See @ref_lut_compose for details */
+	for (color = 0; color < 3; color++) {
+		uint16_t *in, *out;
+
+		if (color == 0) {
+			in = in_red;
+			out = &out_lut[0].red;
+		} else if (color == 1) {
+			in = in_green;
+			out = &out_lut[0].green;
+		} else {
+			in = in_blue;
+			out = &out_lut[0].blue;
+		}
+
+		for (i = 0; i < len_out; i++) {
+			i_l = i * i_amax / i_bmax;
+			i_r = i_l + !!(i_amax - i_l);
+
+			coeff_ibmax = (i * i_amax) - (i_l * i_bmax);
+			out_ibmax = i_bmax * in[i_l] +
+				      coeff_ibmax * (in[i_r] - in[i_l]);
+
+			*(uint16_t*)((char*)out + (i*struct_size)) =
+				out_ibmax / i_bmax;
+		}
+	}
+
+	for (i = 0; i < len_out; i++)
+		out_lut[i].reserved = 0;
+}
+
+enum lut_fill {
+	LUT_FILL_RANDOM,
+	LUT_FILL_IDENTITY,
+	LUT_FILL_SATURATED,
+	LUT_FILL_COUNT
+};
+
+static void
+lut_fill(uint16_t *lut, uint32_t len, enum lut_fill fill)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		switch (fill) {
+		case LUT_FILL_RANDOM:
+			lut[i] = rand() & 0xffff;
+			break;
+		case LUT_FILL_IDENTITY:
+			lut[i] = i * 0xffff / (len - 1);
+			break;
+		case LUT_FILL_SATURATED:
+			lut[i] = 0xffff;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static int
+lut_check(uint32_t len_a, uint32_t len_b, enum lut_fill fill)
+{
+	uint16_t red[LUT_SIZE_MAX], green[LUT_SIZE_MAX], blue[LUT_SIZE_MAX];
+	static struct drm_color_lut b_lut[LUT_SIZE_MAX];
+	static struct drm_color_lut ref[LUT_SIZE_MAX], out[LUT_SIZE_MAX];
+	size_t size = len_b * sizeof(struct drm_color_lut);
+	uint32_t i;
+
+	lut_fill(red, len_a, fill);
+	lut_fill(green, len_a, LUT_FILL_RANDOM);
+	lut_fill(blue, len_a, fill == LUT_FILL_IDENTITY ?
+		 LUT_FILL_SATURATED : fill);
+
+	for (i = 0; i < len_b; i++) {
+		b_lut[i].red = rand() & 0xffff;
+		b_lut[i].green = rand() & 0xffff;
+		b_lut[i].blue = rand() & 0xffff;
+		b_lut[i].reserved = rand() & 0xffff;
+	}
+
+	memset(ref, 0xaa, size);
+	memset(out, 0x55, size);
+	ref_lut_compose(red, green, blue, b_lut, ref, len_a, len_b);
+	drmmode_lut_compose(red, green, blue, b_lut, out, len_a, len_b);
+	if (memcmp(ref, out, size) != 0) {
+		fprintf(stderr, "compose mismatch: len_a %u len_b %u fill %d\n",
+			len_a, len_b, fill);
+		return 1;
+	}
+
+	memset(ref, 0xaa, size);
+	memset(out, 0x55, size);
+	ref_lut_interpolate(red, green, blue, ref, len_a, len_b);
+	drmmode_lut_interpolate(red, green, blue, out, len_a, len_b);
+	if (memcmp(ref, out, size) != 0) {
+		fprintf(stderr, "interpolate mismatch: len_in %u len_out %u fill %d\n",
+			len_a, len_b, fill);
+		return 1;
+	}
+
+	return 0;
+}
+
+int
+main(void)
+{
+	/* Legacy gamma sizes used by the X server, and common hardware
+	 * DEGAMMA/GAMMA_LUT_SIZE values.
+	 */
+	static const uint32_t sizes[] = { 2, 3, 256, 1024, 4096 };
+	int failed = 0;
+	uint32_t n, i;
+	int fill;
+
+	srand(1);
+
+	for (n = LUT_SIZE_MIN; n <= LUT_SIZE_MAX; n++) {
+		for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+			failed |= lut_check(n, sizes[i], LUT_FILL_RANDOM);
+			failed |= lut_check(sizes[i], n, LUT_FILL_RANDOM);
+		}
+	}
+
+	for (n = 0; n < ARRAY_SIZE(sizes); n++) {
+		for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+			for (fill = 0; fill < LUT_FILL_COUNT; fill++)
+				failed |= lut_check(sizes[n], sizes[i], fill);
+		}
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright © 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Checks that amdgpu_parallel_run, which splits Composite fallbacks and
+ * ShadowFB updates into bands, calls the job function exactly once for each
+ * index and only returns after all calls have completed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "amdgpu_parallel.h"
+
+#define PARALLEL_MAX_JOBS 256
+#define PARALLEL_ROUNDS 1000
+
+struct parallel_check {
+	/* Written by one job each, read after amdgpu_parallel_run returns */
+	int calls[PARALLEL_MAX_JOBS];
+	int count;
+	int out_of_range;
+};
+
+static void
+parallel_job(void *data, int index)
+{
+	struct parallel_check *check = data;
+	volatile unsigned spin;
+
+	if (index < 0 || index >= check->count) {
+		__atomic_store_n(&check->out_of_range, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	/* Vary the job length, so that jobs finish out of order */
+	for (spin = 0; spin < (unsigned)(index % 7) * 1000; spin++)
+		;
+
+	__atomic_add_fetch(&check->calls[index], 1, __ATOMIC_RELAXED);
+}
+
+int
+main(void)
+{
+	static struct parallel_check check;
+	int round, count, i;
+
+	printf("Using %d threads\n", amdgpu_parallel_threads());
+
+	for (round = 0; round < PARALLEL_ROUNDS; round++) {
+		count = round % (PARALLEL_MAX_JOBS + 1);
+
+		memset(&check, 0, sizeof(check));
+		check.count = count;
+
+		amdgpu_parallel_run(parallel_job, &check, count);
+
+		if (check.out_of_range) {
+			fprintf(stderr, "count %d: job index out of range\n",
+				count);
+			return EXIT_FAILURE;
+		}
+
+		for (i = 0; i < count; i++) {
+			if (__atomic_load_n(&check.calls[i],
+					    __ATOMIC_RELAXED) != 1) {
+				fprintf(stderr, "count %d: job %d ran %d times\n",
+					count, i, check.calls[i]);
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
+	return EXIT_SUCCESS;
+}